@@ -0,0 +1,174 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/*
+ * Bump allocator for everything one assembly builds up. Memory comes out
+ * of a list of chunks, each twice the size of the last, and is only ever
+ * given back all at once by release(). Blocks too big to bump (the grown
+ * buffers of vectors, mostly) get a block of their own on a side list so a
+ * growing container doesn't leave all of its old copies behind. Each
+ * assembly has its own, so they aren't locked; the prefetch threads keep
+ * to the regular heap.
+ */
+#define ARENA_CHUNK 0x100000
+#define ARENA_LARGE 0x10000
+#define ARENA_ALIGN 0x10
+
+class arena {
+private:
+	struct chunk {
+		chunk *next;
+		size_t size;
+	};
+
+	struct large {
+		large *next, *prev;
+		size_t size;
+		size_t pad;
+	};
+
+	chunk *head {};
+	large *bigs {};
+	char *cur {}, *end {};
+	size_t next_size {};
+	size_t used {}, peak {};
+	u64 allocs {}, chunks {};
+
+	void *refill(size_t n)
+	{
+		size_t size = next_size ? next_size : ARENA_CHUNK;
+		chunk *c;
+
+		while (size < n + sizeof(chunk)) size *= 2;
+		if (!(c = (chunk *) malloc(size)))
+			throw std::bad_alloc();
+		c->next = head;
+		c->size = size;
+		head = c;
+		cur = (char *) (c + 1);
+		end = (char *) c + size;
+		next_size = size * 2;
+		chunks++;
+		return cur;
+	}
+
+	void *alloc_large(size_t n)
+	{
+		large *b;
+
+		if (!(b = (large *) malloc(sizeof(large) + n)))
+			throw std::bad_alloc();
+		b->next = bigs;
+		b->prev = NULL;
+		b->size = n;
+		if (bigs) bigs->prev = b;
+		bigs = b;
+		return b + 1;
+	}
+
+	void free_large(void *p)
+	{
+		large *b = (large *) p - 1;
+
+		if (b->prev) b->prev->next = b->next;
+		else bigs = b->next;
+		if (b->next) b->next->prev = b->prev;
+		::free(b);
+	}
+
+public:
+	void *alloc(size_t n)
+	{
+		n = (n + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+		allocs++;
+		used += n;
+		if (used > peak) peak = used;
+		if (n >= ARENA_LARGE)
+			return alloc_large(n);
+
+		if ((size_t) (end - cur) < n) refill(n);
+
+		void *p = cur;
+		cur += n;
+		return p;
+	}
+
+	/* Large blocks and the last small block handed out can be given
+	   back, anything older just stays until release() */
+	void free(void *p, size_t n)
+	{
+		n = (n + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+		if (!p || (!head && !bigs)) return;
+		if (n >= ARENA_LARGE) {
+			free_large(p);
+			used -= n;
+		} else if ((char *) p + n == cur) {
+			cur = (char *) p;
+			used -= n;
+		}
+	}
+
+	void *resize(void *p, size_t old, size_t n)
+	{
+		size_t o = (old + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+		void *q;
+
+		if (p && o < ARENA_LARGE && n < ARENA_LARGE && (char *) p + o == cur && (size_t) (end - (char *) p) >= n) {
+			free(p, old);
+			return alloc(n);
+		}
+
+		q = alloc(n);
+		if (p) {
+			memcpy(q, p, old < n ? old : n);
+			free(p, old);
+		}
+		return q;
+	}
+
+	template <class T, class... A> T *make(A&&... a)
+	{
+		return new (alloc(sizeof(T))) T(std::forward<A>(a)...);
+	}
+
+	/* Everything handed out so far is gone after this, destructors
+	   included, so nothing in here may own memory of its own */
+	void release()
+	{
+		for (chunk *c = head, *n; c; c = n) {
+			n = c->next;
+			::free(c);
+		}
+		for (large *b = bigs, *n; b; b = n) {
+			n = b->next;
+			::free(b);
+		}
+		head = NULL;
+		bigs = NULL;
+		cur = end = NULL;
+		next_size = used = 0;
+	}
+
+	u64 allocations() const { return allocs; }
+	u64 chunk_count() const { return chunks; }
+	size_t peak_bytes() const { return peak; }
+};
+
+/* For the standard containers, which carry the arena they came from */
+template <class T> struct arena_allocator {
+	typedef T value_type;
+	arena *a;
+
+	arena_allocator(arena *a) : a(a) {}
+	template <class U> arena_allocator(const arena_allocator<U>& o) : a(o.a) {}
+
+	T *allocate(size_t n) { return (T *) a->alloc(n * sizeof(T)); }
+	void deallocate(T *p, size_t n) { a->free(p, n * sizeof(T)); }
+
+	template <class U> bool operator==(const arena_allocator<U>& o) const { return a == o.a; }
+	template <class U> bool operator!=(const arena_allocator<U>& o) const { return a != o.a; }
+};
+
+template <class T> using arena_vector = std::vector<T, arena_allocator<T>>;
+
+#endif
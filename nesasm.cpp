@@ -0,0 +1,2864 @@
+/*
+ * 6502 assembler processor support for NES, the library behind the
+ * command line in main.cpp
+ */
+#include <string>
+#include <new>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <ctype.h>
+#include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "nesasm.h"
+#include "types.h"
+#include "mapper_hdr.h"
+#include "arena.h"
+#include "syms.h"
+#include "scan.h"
+#include "opcodes.h"
+
+class buffer_reader {
+private:
+	char *buffer {};
+	size_t size {};
+	size_t map_size {};
+	size_t cap {};
+	size_t ready {};
+	char held {};
+	int stream_fd {-1};
+	bool file_fail {};
+	u32 idx {};
+	std::string path {};
+	std::vector<u32> line_starts {};
+	size_t indexed {};
+
+	/* Map the file straight out of the page cache. The mapping is placed
+	   in an anonymous reservation one page larger than the file, so the
+	   zero tail of the last page plus the guard page keep the same NUL
+	   sentinel guarantee as the heap copy. */
+	bool map_file(int fd)
+	{
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t len = ((size + page - 1) & ~(page - 1)) + page;
+		void *base, *p;
+
+		base = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED)
+			return false;
+
+		p = mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+		if (p == MAP_FAILED) {
+			munmap(base, len);
+			return false;
+		}
+
+		madvise(base, size, MADV_SEQUENTIAL);
+		buffer = (char *) base;
+		map_size = len;
+		return true;
+	}
+
+	/* Pipes, ttys and anything else we can't map are streamed. Only the
+	   complete lines read so far are handed to the lexer, a NUL is held
+	   in place right after the last newline until more data arrives. */
+	void open_stream(int fd)
+	{
+		stream_fd = fd;
+		cap = 0x10000;
+		size = ready = 0;
+		buffer = new char[cap + 0x20];
+		held = buffer[0];
+		buffer[0] = '\0';
+	}
+public:
+	/* Reads until at least one more complete line (or the end of the
+	   input) is available, false once everything has been handed out */
+	bool fill()
+	{
+		ssize_t n;
+		char *p;
+
+		if (stream_fd < 0)
+			return false;
+
+		buffer[ready] = held;
+		for (;;) {
+			if (size == cap) {
+				p = new char[cap * 2 + 0x20];
+				memcpy(p, buffer, size);
+				delete[] buffer;
+				buffer = p;
+				cap *= 2;
+			}
+
+			n = read(stream_fd, buffer + size, cap - size);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				file_fail = true;
+				n = 0;
+			}
+
+			if (n == 0) {
+				if (stream_fd) close(stream_fd);
+				stream_fd = -1;
+				memset((void *) (buffer + size), 0, 0x20);
+				ready = size;
+				return true;
+			}
+
+			size += n;
+			for (p = buffer + size; p > buffer + ready && p[-1] != '\n'; --p);
+			if (p > buffer + ready) {
+				ready = p - buffer;
+				held = buffer[ready];
+				buffer[ready] = '\0';
+				return true;
+			}
+		}
+	}
+
+	bool valid_extension(const char *format,
+					 	 const char *extension)
+	{
+		int i = strlen(format) - strlen(extension);
+		if (i < 0) return false;
+		format += i;
+		return !strcmp(format, extension) ? true : false;
+	}
+
+	/* "-" is the standard input */
+	bool open_file(const char *file)
+	{
+		struct stat st;
+		int fd = strcmp(file, "-") ? open(file, O_RDONLY) : 0;
+		file_fail = false;
+		path = fd ? file : "<stdin>";
+		line_starts.assign(1, 0);
+		indexed = 0;
+		idx = 0;
+
+		if (fd < 0) {
+			file_fail = true;
+			return false;
+		}
+
+		size = 0;
+		map_size = 0;
+		if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+			size = st.st_size;
+			if (map_file(fd)) {
+				if (fd) close(fd);
+				return true;
+			}
+		}
+
+		open_stream(fd);
+		return true;
+	}
+
+	/* Source handed over in memory, copied so it gets the padding */
+	bool open_memory(const char *file, const char *p, size_t n)
+	{
+		path = file;
+		line_starts.assign(1, 0);
+		indexed = 0;
+		idx = 0;
+		file_fail = false;
+		map_size = 0;
+		stream_fd = -1;
+		size = ready = cap = n;
+		buffer = new char[n + 0x20];
+		memcpy(buffer, p, n);
+		memset(buffer + n, 0, 0x20);
+		return true;
+	}
+
+	/* Line numbers only matter for diagnostics, so instead of counting
+	   them while lexing the line starts are indexed on first use and
+	   looked up by offset. Streamed input extends the index as it grows. */
+	u32 line_of(u32 off)
+	{
+		const char *p;
+
+		if (off >= indexed && indexed < size) {
+			for (p = buffer + indexed; (p = (const char *) memchr(p, '\n', buffer + size - p)); ++p)
+				line_starts.push_back(p + 1 - buffer);
+			indexed = size;
+		}
+
+		return std::upper_bound(line_starts.begin(), line_starts.end(), off) - line_starts.begin();
+	}
+
+	/* Touches every page of a mapped file so the disk reads happen on
+	   the calling thread instead of in the lexer */
+	void prefault()
+	{
+		size_t page = sysconf(_SC_PAGESIZE);
+		volatile char sink;
+
+		if (!map_size) return;
+		for (size_t off = 0; off < size; off += page) sink = buffer[off];
+		(void) sink;
+	}
+
+	inline u32 cur_line() { return line_of(idx); }
+	inline const char *name() { return path.c_str(); }
+	inline void seek(u32 off) { idx = off; }
+	inline u8 read_buffer() { return buffer[idx]; }
+	inline u8 step_buffer() { return ++idx; }
+	inline u8 rewind_buffer() { return --idx; }
+	inline const char *cursor() { return buffer + idx; }
+	inline const char *data() { return buffer; }
+	inline const char *text(const Sym *s) { return buffer + s->offset; }
+	inline u32 tell() { return idx; }
+	inline size_t length() { return size; }
+	inline void skip(size_t n) { idx += n; }
+	inline bool is_fail() { return file_fail; }
+	inline bool is_complete() { return stream_fd < 0; }
+	inline void end_buffer()
+	{
+		if (stream_fd > 0) close(stream_fd);
+		if (map_size) munmap(buffer, map_size);
+		else delete[] buffer;
+		buffer = NULL;
+		map_size = 0;
+		stream_fd = -1;
+	}
+};
+
+/* For the phase timings reported with -stats */
+static inline double now_ms()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Every file the assembly touches, opened once and shared by all of the
+   includes naming it. Files named by include directives are loaded on a
+   few background threads ahead of time, so when the parser gets to the
+   directive the bytes are usually already resident and load() only has
+   to wait on the ones that aren't. */
+#define PREFETCH_THREADS 4
+
+/* A loaded file and what the assembler has learned about it so far */
+struct source_file {
+	std::string path;
+	buffer_reader t;
+	int state;
+	bool ok;
+	TokenBuffer *tokens;	// lexed once, replayed by every later include
+	u64 hash;
+	bool hashed;
+	bool once;		// had a .once, so only the first include counts
+	bool included;
+};
+
+/* Word at a time FNV style hash, the zero padding after the data makes
+   reading the last partial word safe */
+static u64 hash_bytes(const char *p, size_t n)
+{
+	u64 h = 0xcbf29ce484222325ull ^ n, w;
+
+	for (size_t i = 0; i < n; i += 8) {
+		memcpy(&w, p + i, sizeof w);
+		h = (h ^ w) * 0x100000001b3ull;
+		h ^= h >> 32;
+	}
+
+	return h;
+}
+
+class source_manager {
+private:
+	enum { QUEUED, LOADING, DONE };
+	typedef source_file source;
+
+	/* Token streams by content, so the same text under another path
+	   (a copy, or ./x.asm next to x.asm) isn't lexed again either */
+	struct cached_tokens {
+		source *origin;
+		TokenBuffer *tokens;
+	};
+
+	std::unordered_map<std::string, source *> files {};
+	std::unordered_map<u64, cached_tokens> token_cache {};
+	std::deque<source *> queue {};
+	std::vector<std::thread> workers {};
+	std::mutex lock {};
+	std::condition_variable work {}, loaded {};
+	bool stop {};
+
+	void hash(source *s)
+	{
+		if (!s->hashed) s->hash = hash_bytes(s->t.data(), s->t.length());
+		s->hashed = true;
+	}
+
+	static bool is_include(const char *p, size_t n)
+	{
+		static const char *names[] = { "include", "import", "inc", "incbin", "chrbin" };
+		for (const char *name : names)
+			if (strlen(name) == n && !memcmp(p, name, n)) return true;
+		return false;
+	}
+
+	/* Cheap look through a freshly loaded file for the files it pulls
+	   in, so nested includes are queued before the lexer reaches them.
+	   A false hit in a comment only costs a wasted load. */
+	void scan_includes(buffer_reader *t)
+	{
+		const char *p = t->data(), *end = p + t->length(), *q;
+
+		while ((p = (const char *) memchr(p, '.', end - p))) {
+			for (q = ++p; q < end && isalpha(*q); ++q);
+			if (!is_include(p, q - p)) continue;
+			while (q < end && is_blank(*q)) ++q;
+			if (q == end || *q++ != '"') continue;
+			for (p = q; p < end && *p != '"' && *p != '\n'; ++p);
+			if (p < end && *p == '"') prefetch(std::string(q, p - q));
+		}
+	}
+
+	void worker()
+	{
+		std::unique_lock<std::mutex> l(lock);
+
+		for (;;) {
+			work.wait(l, [this] { return stop || !queue.empty(); });
+			if (stop) return;
+
+			source *s = queue.front();
+			queue.pop_front();
+			if (s->state != QUEUED) continue;
+			s->state = LOADING;
+
+			l.unlock();
+			s->ok = s->t.open_file(s->path.c_str());
+			if (s->ok) {
+				s->t.prefault();
+				scan_includes(&s->t);
+			}
+			l.lock();
+
+			s->state = DONE;
+			loaded.notify_all();
+		}
+	}
+
+public:
+	double load_ms {};
+	/* Set, every file comes from here and nothing is read from disk */
+	nesasm_resolver resolve {};
+
+	~source_manager() { release(); }
+
+	/* Queues a file for the background threads, nothing if it's known */
+	void prefetch(const std::string& file)
+	{
+		std::lock_guard<std::mutex> l(lock);
+
+		if (stop || resolve || file == "-" || files.count(file))
+			return;
+
+		source *s = new source { file, {}, QUEUED };
+		files[file] = s;
+		queue.push_back(s);
+		if (workers.size() < PREFETCH_THREADS)
+			workers.emplace_back(&source_manager::worker, this);
+		work.notify_one();
+	}
+
+	/* A file nobody has started on yet is opened right here, otherwise
+	   this waits for the thread loading it */
+	source *load(const char *file)
+	{
+		double start = now_ms();
+		std::unique_lock<std::mutex> l(lock);
+		source *s = files[file];
+
+		if (!s) {
+			s = new source { file, {}, QUEUED };
+			files[file] = s;
+		}
+
+		if (s->state == QUEUED) {
+			s->state = LOADING;
+			l.unlock();
+			if (resolve) {
+				std::string text;
+				s->ok = resolve(file, text) && s->t.open_memory(file, text.data(), text.size());
+			} else {
+				s->ok = s->t.open_file(file);
+			}
+			l.lock();
+			s->state = DONE;
+		}
+
+		loaded.wait(l, [s] { return s->state == DONE; });
+		load_ms += now_ms() - start;
+		return s->ok ? s : NULL;
+	}
+
+	/* A file that's already in memory, load() finds it by name */
+	void add(const char *file, const char *p, size_t n)
+	{
+		std::lock_guard<std::mutex> l(lock);
+		source *s = files[file];
+
+		if (s) {
+			s->t.end_buffer();
+			s->tokens = NULL;
+			s->hashed = false;
+		} else {
+			s = files[file] = new source { file, {}, DONE };
+		}
+		s->state = DONE;
+		s->ok = s->t.open_memory(file, p, n);
+	}
+
+	/* Tokens of an earlier lex of the same path or the same contents,
+	   NULL if the file still has to be lexed */
+	TokenBuffer *tokens(source *s)
+	{
+		if (s->tokens || !s->t.is_complete())
+			return s->tokens;
+
+		hash(s);
+		auto it = token_cache.find(s->hash);
+		if (it != token_cache.end()) {
+			source *o = it->second.origin;
+			if (o->t.length() == s->t.length() && !memcmp(o->t.data(), s->t.data(), s->t.length()))
+				s->tokens = it->second.tokens;
+		}
+
+		return s->tokens;
+	}
+
+	/* Remembers a freshly lexed token buffer, the arena owns it */
+	void cache(source *s, TokenBuffer *tb)
+	{
+		s->tokens = tb;
+		hash(s);
+		if (!token_cache.count(s->hash))
+			token_cache[s->hash] = { s, tb };
+	}
+
+	/* Every file unincluded again, for another pass */
+	void rewind()
+	{
+		for (auto& f : files) f.second->once = f.second->included = false;
+	}
+
+	void release()
+	{
+		{
+			std::lock_guard<std::mutex> l(lock);
+			stop = true;
+		}
+		work.notify_all();
+		for (auto& w : workers) w.join();
+
+		for (auto& f : files) {
+			f.second->t.end_buffer();
+			delete f.second;
+		}
+		token_cache.clear();
+		files.clear();
+		queue.clear();
+		workers.clear();
+		stop = false;
+	}
+};
+
+/* A file being parsed. Includes push a frame instead of recursing, the
+   parent resumes at (line, tok) once the included file is done. */
+struct include_frame {
+	source_file *src;
+	TokenBuffer *tb;
+	u32 line, tok;
+};
+
+/* A symbol the last pass never defined */
+#define NO_VALUE ((s32) 0x80000000)
+#define MAX_PASSES 32
+
+/* -O peephole rewrites, each counted for -stats */
+enum { PEEP_TAIL_CALL, PEEP_RELOAD, PEEP_STORE_LOAD, PEEP_KNOWN_FLAG, PEEP_KNOWN_VALUE, PEEP_FUSE, PEEP_RULES };
+static const char *const peep_names[PEEP_RULES] = { "jsr+rts", "reload", "store+load", "known flag", "known value", "fused" };
+
+/* What an operand expression came to. node is the root in exprs when
+   a label in it isn't defined yet, width is ZEROPAGE or ABSOLUTE. With
+   label set a label went into it, so the width follows the value rather
+   than how many digits were written. */
+struct expr_value {
+	s32 value;
+	u32 node;
+	u16 width;
+	bool known;
+	bool label;
+};
+
+/* The instruction the peephole looks back at, at is where its opcode
+   sits in text_bin */
+struct last_insn {
+	u32 at;
+	u8 m;
+	u16 mode;
+	s32 value;
+	u32 node;
+	bool known;
+	bool label;	// one was defined after it
+};
+
+/* One assembly from source to rom. Everything it builds up lives in
+   here, so any number of them can run side by side on their own
+   threads. */
+class Assembler {
+public:
+	const char *prog;
+	FILE *diag;
+	bool show_token_debugger {1};
+	bool show_stats;
+	u8 prg_rom_size, chr_rom_size;
+	bool mirroring, battery_backed, trainer;
+	std::string main_reloc;
+	bool optimize, undocumented;
+
+	Assembler(const nesasm_options& o)
+		: prog(o.prog), diag(o.diag), show_stats(o.show_stats),
+		  prg_rom_size(o.prg_rom_size), chr_rom_size(o.chr_rom_size),
+		  mirroring(o.mirroring), battery_backed(o.battery_backed), trainer(o.trainer),
+		  main_reloc(o.main_reloc), optimize(o.optimize), undocumented(o.undocumented), options(o), guessed(o.optimize) {}
+	Assembler(const Assembler&) = delete;
+	~Assembler() { sources.release(); mem.release(); }
+
+	/* Sources come from resolve instead of the filesystem */
+	void resolve_with(const nesasm_resolver& r) { sources.resolve = r; }
+	void add_source(const char *file, const std::string& text) { sources.add(file, text.data(), text.size()); }
+
+	int assemble(const char *file, std::vector<u8>& rom);
+	void export_symbols(std::vector<nesasm_symbol>& out);
+
+private:
+	/* First, so it outlives every container drawing from it */
+	arena mem {};
+	source_manager sources {};
+	const nesasm_options options;	// what every pass starts from
+
+	arena_vector<include_frame> includes { &mem };
+	source_file *pending_include {};
+	u64 include_count {}, token_hits {}, once_skips {};
+
+	addr_t TEXT_PC = 0xC000;
+	arena_vector<u8> text_bin { &mem };
+	inline void SET_TEXT_PC(u32 addr) { TEXT_PC = addr; }
+	inline void ADD_TEXT_PC(u32 addr) { TEXT_PC += addr; }
+
+	u32 DATA_PC = 0x0000;
+	arena_vector<u8> data_bin { &mem };
+	inline void SET_DATA_PC(u32 addr) { DATA_PC = addr; }
+	inline void ADD_DATA_PC(u32 addr) { DATA_PC += addr; }
+
+	u32 RODATA_PC = 0x0000;
+	arena_vector<u8> rodata_bin { &mem };
+	inline void SET_RODATA_PC(u32 addr) { RODATA_PC = addr; }
+	inline void ADD_RODATA_PC(u32 addr) { RODATA_PC += addr; }
+
+	addr_t section = TEXT_SECTION;
+	u16 mapper_type = NROM_MAPPER_TYPE;
+	u32 oldpc = TEXT_PC;
+	bool chr_taken {};
+
+	/* Lexer */
+	char c {};
+	int fast_skip {};
+	bool parse_line {};
+	bool angle_strings {};
+	Sym current_symbol {};
+	inline Sym *read_sym() { return &current_symbol; }
+	arena_vector<Sym> SymTable { &mem };
+	int errs {};
+
+	arena_vector<Fixup> fixups { &mem };
+	arena_vector<Expr> exprs { &mem };
+	intern_pool symbols { &mem };
+	Label label {};
+	arena_vector<Label> labels { &mem };
+	arena_vector<Variable> variables { &mem };
+	arena_vector<u32> label_index { &mem }, variable_index { &mem };
+
+	/* Relaxation. A pass that sized something from a label it hadn't
+	   seen yet runs again with where the last pass put every symbol,
+	   until nothing moves. Sites are the instructions whose form can
+	   change, numbered in source order, and only ever grow. */
+	u32 pass {1};
+	bool guessed;
+	u32 site {};
+	arena_vector<u8> site_long { &mem };
+	arena_vector<s32> settled { &mem }, last_pass { &mem };
+	arena_vector<Jump> jumps { &mem }, last_jumps { &mem };
+	arena_vector<u32> unsized { &mem };
+	u64 long_branches {}, threaded {}, shortened {};
+	u64 zp_operands {}, zp_bytes {}, zp_cycles {};
+
+	/* -O dataflow, flow is what's known at the instruction at hand. A
+	   label starts from the meet of its fallthrough, the jumps to it
+	   this pass has seen so far and the ones further down the last pass
+	   saw. Nothing is known there in the first pass, at the entry point,
+	   at a label whose address is used for anything but a jump to it,
+	   or anywhere once a jump went somewhere that isn't a label. */
+	flow_state flow {};
+	arena_vector<flow_state> edges { &mem }, later { &mem }, last_later { &mem };
+	arena_vector<u32> refs { &mem }, direct { &mem };
+	arena_vector<u8> last_open { &mem };
+	u32 ref_id {}, bare {}, last_main {};
+	bool wild {}, last_wild {};
+	std::string notes;	// -report
+
+	/* -O peephole */
+	last_insn last {};
+	u64 peeps[PEEP_RULES] {};
+
+	/* Reported with -stats */
+	u64 lex_allocs {}, lex_tokens {};
+	double lex_ms {}, parse_ms {}, link_ms {};
+
+	void parse_escape_seq(buffer_reader *t);
+	int read_string(buffer_reader *t, char skip);
+	bool skip_comment(buffer_reader *t, char v);
+	int read_value(buffer_reader *t);
+	int read_bin_value(buffer_reader *t);
+	bool is_token(buffer_reader *t);
+	Sym *next_sym(buffer_reader *t);
+	bool skip_whitespace(buffer_reader *t);
+	Sym *next_arg(TokenBuffer& tb, u32& i, u32 end);
+	bool preprocessor(buffer_reader *t, TokenBuffer& tb, u32 i, u32 end);
+	bool save_sym(buffer_reader *t, TokenBuffer& tb);
+
+	u32& index_slot(arena_vector<u32>& index, u32 name);
+	void save_instruction(u8 opcode, u8 bytes, u16 value, u8 kind = 0, u32 expr = 0);
+	bool save_label(Label label);
+	size_t find_label(Label& label);
+	bool save_variable(Variable var);
+	size_t find_variable(Variable& var);
+	template<typename T>
+	bool add_data_byte(Sym *temp, buffer_reader *t, size_t& i, void (Assembler::*callback)(u32 pc), T& bin, u8 use_end = 0);
+	bool parse_primary(buffer_reader *t, size_t& i, size_t size, expr_value& v);
+	bool parse_expr(buffer_reader *t, size_t& i, size_t size, expr_value& v, int min_prec = 1);
+	u32 expr_node(const expr_value& v);
+	bool eval_expr(u32 node, s32& v, u32& missing, bool guess = false);
+	bool mentions(u32 node, u32 id);
+	bool guess_value(const expr_value& v, s32& r);
+	s32 thread_jump(s32 target);
+	u8 taken_branch();
+	void track(int m, u16 mode, const expr_value& v);
+	void grow_flow(u32 id);
+	void flow_edge(const flow_state& s);
+	void enter_label(u32 id);
+	bool holds(u8 r, u8 value);
+	void report(buffer_reader *t, int rule, const char *what, int m);
+	void encode_branch(u8 code, const expr_value& v);
+	void encode_jump(int m, const opcode& op, const expr_value& v);
+	bool fits_zeropage(const expr_value& v);
+	bool peephole(buffer_reader *t, int m, u16 mode, const expr_value& v);
+	void note_insn(int m, u16 mode, const expr_value& v, u32 at);
+	bool widens();
+	bool parse_operand(buffer_reader *t, const Sym *x, size_t& i, size_t size, u16& mode, expr_value& v);
+	bool encode_instruction(buffer_reader *t, const Sym *x, size_t& i, size_t size);
+	bool regex(buffer_reader *t);
+
+	void end_line(buffer_reader *t, TokenBuffer& tb);
+	bool lex_data_list(buffer_reader *t, TokenBuffer& tb);
+	void lex_lines(buffer_reader *t, TokenBuffer& tb);
+	void lex_file(buffer_reader *t, TokenBuffer& tb);
+	bool parse_tokens(include_frame& f);
+	void prefetch_includes(buffer_reader *t, TokenBuffer& tb);
+	void compile_file(source_file *root);
+	bool check_errors();
+	void rewind();
+	bool settle();
+	void relax(source_file *root);
+	int compile_assembler(const char *file);
+	int link(std::vector<u8>& rom);
+	void print_stats();
+};
+
+static bool is_instruction_mask(char c) {
+	static const char instruction_token[] = "@_0123456789abcdefghijklmnopqrstuvwxyz";
+
+	int i;
+	for (i = 0; i < 39; i++) {
+		if (tolower(c) == instruction_token[i]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool is_hex_mask(char c) {
+	int i;
+	static const char hexadecimal[] = "0123456789abcdef";
+
+	for (i = 0; i < 16; i++) {
+		if (tolower(c) == hexadecimal[i]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool is_binary_mask(char c) {
+	int i;
+	static const char binary[] = "01";
+
+	for (i = 0; i < 16; i++) {
+		if (c == binary[i]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Heap traffic of the lexer, reported with -stats. Per thread so the
+   prefetch threads don't show up in it. */
+thread_local unsigned long long nesasm_heap_allocs {};
+
+static inline bool sym_is(buffer_reader *t, const Sym *s, const char *str)
+{
+	return !strncmp(t->text(s), str, s->length) && !str[s->length];
+}
+
+void Assembler::parse_escape_seq(buffer_reader *t)
+{
+
+}
+
+int Assembler::read_string(buffer_reader *t, char skip)
+{
+	read_sym()->offset = t->tell() + 1;
+	do {
+		t->step_buffer();
+		c = t->read_buffer();
+		if (c == '\\') {
+			parse_escape_seq(t);
+			c = t->read_buffer();
+			if (c == '\0' || c == '\n') goto sterr;
+		}
+	} while (c && c != skip && c != '\n');
+
+	sterr:
+	read_sym()->length = t->tell() - read_sym()->offset;
+	if (c != skip) {
+		throwback("Expected %c", skip);
+		read_sym()->id = NONE;
+	} else {
+		c = t->read_buffer();
+		read_sym()->id = STRING;
+		return 0;
+	}
+
+	return 1;
+}
+
+bool Assembler::skip_comment(buffer_reader *t, char v) {
+	if (t->read_buffer() == v) {
+		t->skip(scan.line(t->cursor()));
+		c = t->read_buffer();
+		read_sym()->id = NONE;
+		t->rewind_buffer();
+		return true;
+	}
+
+	return false;
+}
+
+int Assembler::read_value(buffer_reader *t)
+{
+	int i, zeros;
+
+	if (!is_hex_mask(c = t->read_buffer())) {
+		throwback("error: expected hexadecimal value");
+		errs++;
+		read_sym()->id = NONE;
+		t->skip(scan.line(t->cursor()));
+		c = t->read_buffer();
+		t->rewind_buffer();
+	} else {
+		i = 0;
+		zeros = 0;
+		read_sym()->value = 0;
+		do {
+			if (c == '0' && zeros == i) zeros++;
+			read_sym()->value = read_sym()->value << 4 | (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+			i++;
+			t->step_buffer();
+		} while (is_hex_mask(c = t->read_buffer()));
+
+		/* significant digits, a leading zero counts as one */
+		if (zeros) {
+			i -= zeros - 1;
+		}
+
+		t->rewind_buffer();
+		return i;
+	}
+
+	return false;
+}
+
+int Assembler::read_bin_value(buffer_reader *t)
+{
+	int i;
+
+	if (!is_binary_mask(c = t->read_buffer())) {
+		throwback("error: expected binary value");
+		errs++;
+		skip_comment(t, c);
+		read_sym()->id = NONE;
+	} else {
+		i = 0;
+		read_sym()->value = 0;
+		do {
+			if (t->read_buffer()=='1' || t->read_buffer()=='0') { /* ... */ } else{ throwback("error: binary value has only 1 or 0's"); errs++; }
+			read_sym()->value = read_sym()->value << 1 | (c == '1');
+			i++;
+			t->step_buffer();
+		} while (is_hex_mask(c = t->read_buffer()));
+
+		t->rewind_buffer();
+		return i;
+	}
+
+	return false;
+}
+
+bool Assembler::is_token(buffer_reader *t) {
+	if (isalpha(c = t->read_buffer()) || c == '_' || c == '@') {
+			do {
+				t->step_buffer();
+			} while (is_instruction_mask(t->read_buffer()));
+
+			t->rewind_buffer();
+			fast_skip = 1;
+			return true;
+	}
+
+	return false;
+}
+
+Sym *Assembler::next_sym(buffer_reader *t)
+{
+	int size;
+	u32 start = t->tell();
+	u64 allocs = nesasm_heap_allocs;
+	read_sym()->offset = start;
+	read_sym()->length = 0;
+	read_sym()->id = NONE;
+	read_sym()->width = _NONE;
+	read_sym()->value = 0;
+
+	if (is_token(t)) {
+		read_sym()->id = TOKEN;
+	} else if (c == '$') {
+		if (!fast_skip) goto error;
+		t->step_buffer();
+		c = t->read_buffer();
+		if (!is_hex_mask(c)) {
+			read_sym()->id = NONE;
+			throwback("error: Expected hex value before '$'");
+			goto err;
+		}
+
+		if ((size = read_value(t))) {
+			if (size <= 2) {
+				read_sym()->id = ZEROPAGE;
+			} else {
+				if (size > 4) {
+					throwback("warning: absolute value overflow");
+				}
+				read_sym()->id = ABSOLUTE;
+			}
+		}
+	} else if (c == '%') {
+		if (!fast_skip) goto error;
+
+		t->step_buffer();
+		c = t->read_buffer();
+		if (!is_binary_mask(c)) {
+			read_sym()->id = NONE;
+			throwback("error: Expected binary value before '%%'");
+			goto err;
+		}
+
+		if ((size = read_bin_value(t))) {
+			if (size <= 8) {
+				read_sym()->id = ZEROPAGE;
+			} else {
+				if (size > 16) {
+					throwback("warning: absolute binary value overflow");
+				}
+				read_sym()->id = ABSOLUTE;
+			}
+		}
+	} else if (isdigit(c)) {
+		if (!fast_skip) goto error;
+		do {
+			read_sym()->value = read_sym()->value * 10 + (c - '0');
+			t->step_buffer();
+		} while (isdigit(c = t->read_buffer()));
+		t->rewind_buffer();
+		read_sym()->id = DIGIT;
+		read_sym()->width = read_sym()->value <= 0xFF ? ZEROPAGE : ABSOLUTE;
+	} else if (c == '#') {
+		if (!fast_skip) goto error;
+		t->step_buffer();
+		c = t->read_buffer();
+		if (c == '$') {
+			t->step_buffer();
+
+			read_sym()->id = IMMEDIATE;
+			if ((size = read_value(t))) {
+				if (size > 2) {
+					throwback("warning: immediate value overflow");
+				}
+
+				read_sym()->id = IMMEDIATE;
+			}
+		} else if (c == '%') {
+			t->step_buffer();
+			read_sym()->id = IMMEDIATE;
+			if ((size = read_bin_value(t))) {
+				if (size > 8) {
+					throwback("warning: binary value overflow");
+				}
+			}
+		} else if (c && (isalnum(c) || strchr("_@<>(-~*", c))) {
+			/* anything else is an expression, the parser takes it
+			   from the next token */
+			t->rewind_buffer();
+			read_sym()->id = IMMEDIATE_MARK;
+		} else {
+			read_sym()->id = NONE;
+			throwback("Expected '$' or '%%' of value before '#'");
+			goto err;
+		}
+	} else {
+		if (fast_skip) {
+			switch (c = t->read_buffer()) {
+			case '(': read_sym()->id = INDIRECT_OPEN;  break;
+			case ')': read_sym()->id = INDIRECT_CLOSE; break;
+			case ',': read_sym()->id = EXTRA_OPERAND;  break;
+			case ':': read_sym()->id = LABEL;  break;
+			case '=': read_sym()->id = ASSIGNMENT;  break;
+			case '+': read_sym()->id = OPERATOR; read_sym()->value = X_ADD; break;
+			case '-': read_sym()->id = OPERATOR; read_sym()->value = X_SUB; break;
+			case '*': read_sym()->id = OPERATOR; read_sym()->value = X_MUL; break;
+			case '/': read_sym()->id = OPERATOR; read_sym()->value = X_DIV; break;
+			case '&': read_sym()->id = OPERATOR; read_sym()->value = X_AND; break;
+			case '|': read_sym()->id = OPERATOR; read_sym()->value = X_OR;  break;
+			case '^': read_sym()->id = OPERATOR; read_sym()->value = X_XOR; break;
+			case '~': read_sym()->id = OPERATOR; read_sym()->value = X_NOT; break;
+			case '>':
+				read_sym()->id = OPERATOR;
+				read_sym()->value = X_HI;
+				if (t->cursor()[1] == '>') { t->step_buffer(); read_sym()->value = X_SHR; }
+				break;
+			case '<':
+				/* <file> only after a directive, else the low byte */
+				if (angle_strings) { if (read_string(t, '>')) goto err;  goto string; }
+				read_sym()->id = OPERATOR;
+				read_sym()->value = X_LO;
+				if (t->cursor()[1] == '<') { t->step_buffer(); read_sym()->value = X_SHL; }
+				break;
+			case '\'':if (read_string(t, '\'')) goto err; goto string;
+			case '"': if (read_string(t, '"')) goto err;  goto string;
+			default: error: throwback("error: junk '%c'", c); errs++; goto fail;
+			}
+		} else {
+			goto error;
+		fail:
+			t->step_buffer();
+		}
+	}
+
+	read_sym()->length = t->tell() + 1 - start;
+	if (read_sym()->id == TOKEN)
+		read_sym()->value = mnemonic_of(t->text(read_sym()), read_sym()->length);
+	if (read_sym()->id == ZEROPAGE || read_sym()->id == ABSOLUTE || read_sym()->id == IMMEDIATE)
+		read_sym()->width = read_sym()->id;
+string:
+	lex_tokens++;
+	lex_allocs += nesasm_heap_allocs - allocs;
+	return read_sym();
+err:
+	/* leave the newline for the caller, it ends the line */
+	t->skip(scan.line(t->cursor()));
+	c = t->read_buffer();
+	t->rewind_buffer();
+
+	errs++;
+	lex_allocs += nesasm_heap_allocs - allocs;
+	return read_sym();
+}
+
+/* Only blanks, a newline always ends the line being parsed */
+bool Assembler::skip_whitespace(buffer_reader *t)
+{
+	size_t n;
+
+	if (is_blank(c = t->read_buffer()) && (n = scan.blanks(t->cursor()))) {
+		t->skip(n);
+		c = t->read_buffer();
+		return true;
+	}
+
+	c = t->read_buffer();
+	return false;
+}
+
+/* Next argument of a directive, NONE once the line runs out */
+Sym *Assembler::next_arg(TokenBuffer& tb, u32& i, u32 end)
+{
+	if (i < end && tb.kinds[i] != DIRECTIVE) {
+		*read_sym() = tb.at(i++);
+	} else {
+		read_sym()->length = 0;
+		read_sym()->id = NONE;
+	}
+
+	return read_sym();
+}
+
+bool Assembler::preprocessor(buffer_reader *t, TokenBuffer& tb, u32 i, u32 end)
+{
+	int id;
+	*read_sym() = tb.at(i++);
+	if (sym_is(t, read_sym(), "include") || sym_is(t, read_sym(), "import") || sym_is(t, read_sym(), "inc")) {
+		next_arg(tb, i, end);
+
+		if (read_sym()->id != STRING) {
+			throwback("error: expected string");
+			errs++;
+		} else {
+			std::string name(t->text(read_sym()), read_sym()->length);
+			source_file *inc = sources.load(name.c_str());
+
+			if (!inc) {
+				throwback("error: no such file or directory %.*s", (int) read_sym()->length, t->text(read_sym()));
+				errs++;
+			} else if (std::any_of(includes.begin(), includes.end(), [inc](const include_frame& f) { return f.src == inc; })) {
+				throwback("error: recursive include of %s", inc->t.name());
+				errs++;
+			} else if (inc->once && inc->included) {
+				once_skips += pass == 1;
+			} else {
+				pending_include = inc;
+			}
+		}
+	} else if (sym_is(t, read_sym(), "prgsize")) {
+		next_arg(tb, i, end);
+		id = read_sym()->id;
+
+		if (id == ZEROPAGE || id == ABSOLUTE) {
+			prg_rom_size = read_sym()->value;
+		} else if (id == DIGIT) {
+			prg_rom_size = read_sym()->value;
+		} else {
+			throwback("error: expected $oooo format or digit");
+			errs++;
+		}
+
+		if (!prg_rom_size) {
+			throwback("warning: prg size set to defaults to 1");
+			prg_rom_size = 1;
+		}
+	} else if (sym_is(t, read_sym(), "chrsize")) {
+		next_arg(tb, i, end);
+		id = read_sym()->id;
+
+		if (id == ZEROPAGE || id == ABSOLUTE) {
+			chr_rom_size = read_sym()->value;
+		} else if (id == DIGIT) {
+			chr_rom_size = read_sym()->value;
+		} else {
+			throwback("error: expected $oooo format or digit");
+			errs++;
+		}
+
+		if (!chr_rom_size) {
+			throwback("warning: using CHR-RAM");
+		}
+	} else if (sym_is(t, read_sym(), "chrbin") || sym_is(t, read_sym(), "incbin")) {
+		if (chr_rom_size) {
+			next_arg(tb, i, end);
+			if (read_sym()->id != STRING) {
+				throwback("error: Expected string");
+				errs++;
+			} else {
+				std::string name(t->text(read_sym()), read_sym()->length);
+				const char *file = name.c_str();
+				source_file *src = sources.load(file);
+				buffer_reader *bin = src ? &src->t : NULL;
+				if (!bin) {
+					throwback("error: no such chr-rom binary %s", file);
+					errs++;
+				} else {
+					if (!chr_taken) {
+						while (bin->fill());
+						const u8 *data = (const u8 *) bin->data();
+						size_t size = bin->length();
+						if (size != 0x2000 * chr_rom_size) {
+							throwback("warning: Expected exact CHR-ROM size of $%04X and not $%04lX turn on fillbytes=0 to turn on filling bytes with $00's", 0x2000 * chr_rom_size, size);
+							data_bin.insert(data_bin.end(), data, data + size);
+							//for (; iter < 0x2000; ++iter) { data_bin.push_back('\0'); }
+						} else {
+							data_bin.insert(data_bin.end(), data, data + size);
+							ADD_DATA_PC(0x2000 * chr_rom_size);
+						}
+
+						chr_taken = 1;
+					} else {
+						throwback("warning: already taken binary data");
+					}
+				}
+			}
+		} else {
+			throwback("warning: couldn't include binary file since CHR-ROM size is 0");
+		}
+	} else if (sym_is(t, read_sym(), "horizontal")) {
+		mirroring = 0;
+	} else if (sym_is(t, read_sym(), "vertical")) {
+		mirroring = 1;
+	} else if (sym_is(t, read_sym(), "battery")) {
+		battery_backed = true;
+	} else if (sym_is(t, read_sym(), "trainer")) {
+		trainer = 1;
+	} else if (sym_is(t, read_sym(), "reloc")) {
+		next_arg(tb, i, end);
+		if (read_sym()->id != STRING) {
+			throwback("error: Expected string");
+			errs++;
+		} else {
+			main_reloc.assign(t->text(read_sym()), read_sym()->length);
+		}
+	} else if (sym_is(t, read_sym(), "nrom16")) {
+		mapper_type = NROM_MAPPER_TYPE;
+		SET_TEXT_PC(0xC000);
+		SET_DATA_PC(0x2000);
+	} else if (sym_is(t, read_sym(), "nrom32")) {
+		mapper_type = NROM_MAPPER_TYPE;
+		SET_TEXT_PC(0x8000);
+		SET_DATA_PC(0x2000);
+	} else if (sym_is(t, read_sym(), "org")) {
+		next_arg(tb, i, end);
+		id = read_sym()->id;
+		if (id == ZEROPAGE || id == ABSOLUTE) {
+			oldpc = TEXT_PC;
+			SET_TEXT_PC(read_sym()->value);
+		} else if (sym_is(t, read_sym(), "old")) {
+			SET_TEXT_PC(oldpc);
+		} else {
+			throwback("error: expected $oooo format");
+			errs++;
+		}
+
+	} else if (sym_is(t, read_sym(), "mapper")) {
+		next_arg(tb, i, end);
+		id = read_sym()->id;
+		if (id == ZEROPAGE || id == ABSOLUTE) {
+			mapper_type = read_sym()->value;
+		} else if (id == DIGIT) {
+			mapper_type = read_sym()->value;
+		} else {
+			throwback("error: expected $oo format");
+			errs++;
+		}
+
+		switch (mapper_type) {
+		default:throwback("TODO: unsupported mapper %03d", mapper_type);
+		case 0: break;
+		}
+	} else if (sym_is(t, read_sym(), "nes")) {
+		throwback("warning: using processor of type '%.*s'", (int) read_sym()->length, t->text(read_sym()));
+	} else if (sym_is(t, read_sym(), "rodata")) {
+		section = READ_ONLY_SECTION;
+	} else if (sym_is(t, read_sym(), "data")) {
+		section = DATA_SECTION;
+	} else if (sym_is(t, read_sym(), "text")) {
+		section = TEXT_SECTION;
+	} else if (sym_is(t, read_sym(), "once")) {
+		includes.back().src->once = true;
+	} else {
+		throwback("error: invalid preprocessor directive %.*s", (int) read_sym()->length, t->text(read_sym()));
+		errs++;
+		return false;
+	}
+
+	return true;
+}
+
+bool Assembler::save_sym(buffer_reader *t, TokenBuffer& tb)
+{
+	next_sym(t);
+	if (read_sym()->id != NONE) {
+		tb.push(*read_sym());
+
+		if (show_token_debugger) {
+			//throwback("%.*s", (int) read_sym()->length, t->text(read_sym()));
+		}
+
+		parse_line = true;
+	}
+	return true;
+}
+
+/* Encoded bytes go straight into text_bin, an operand that isn't
+   known yet is left zero with a fixup pointing at it */
+void Assembler::save_instruction(u8 opcode, u8 bytes, u16 value, u8 kind, u32 expr)
+{
+	if (kind) {
+		fixups.push_back({ (u32) text_bin.size() + 1, expr, TEXT_PC, kind, TEXT_SECTION });
+	}
+
+	text_bin.push_back(opcode);
+	if (bytes > 1) text_bin.push_back(value & 0xFF);
+	if (bytes > 2) text_bin.push_back(value >> 8);
+	ADD_TEXT_PC(bytes);
+}
+
+/* Tables indexed by symbol id, the name was already hashed once when it
+   was interned so define, lookup and the duplicate check are O(1). Each
+   slot holds the position in labels/variables plus one, 0 if undefined. */
+u32& Assembler::index_slot(arena_vector<u32>& index, u32 name)
+{
+	if (name >= index.size()) index.resize(symbols.count() + 1);
+	return index[name];
+}
+
+bool Assembler::save_label(Label label)
+{
+	u32& slot = index_slot(label_index, label.label);
+
+	if (slot) {
+		return false;
+	}
+
+	labels.push_back(label);
+	slot = labels.size();
+	return true;
+}
+
+size_t Assembler::find_label(Label& label)
+{
+	size_t i = index_slot(label_index, label.label);
+	if (i) {
+		label = labels[i - 1];
+	}
+	return i; /* Do an n - 1 calculation */
+}
+
+bool Assembler::save_variable(Variable var)
+{
+	u32& slot = index_slot(variable_index, var.name);
+
+	if (slot) {
+		return false;
+	}
+
+	variables.push_back(var);
+	slot = variables.size();
+	return true;
+}
+
+size_t Assembler::find_variable(Variable& var)
+{
+	size_t i = index_slot(variable_index, var.name);
+	if (i) {
+		var = variables[i - 1];
+	}
+	return i;
+}
+
+/* What a byte or word operand may hold, known now or at link time */
+static inline bool fixup_fits(u8 kind, s32 v)
+{
+	if (kind == FIXUP_BYTE) return v >= -0x80 && v <= 0xFF;
+	if (kind == FIXUP_WORD) return v >= -0x8000 && v <= 0xFFFF;
+	return true;
+}
+
+template<typename T>
+bool Assembler::add_data_byte(Sym *temp, buffer_reader *t, size_t& i, void (Assembler::*callback)(u32 pc), T& bin, u8 use_end)
+{
+	size_t size { SymTable.size() };
+	const char *name = section == DATA_SECTION ? "data" : "rodata";
+	expr_value v;
+	u32 pc;
+	u8 width {}, kind;
+
+	if (temp->id != TOKEN) {
+		throwback("error: expected token in section .%s", name);
+		return false;
+	}
+
+	if (sym_is(t, temp, "byte") || sym_is(t, temp, "db")) width = 1;
+	if (sym_is(t, temp, "word") || sym_is(t, temp, "dw")) width = 2;
+	if (!width) {
+		throwback("error: expected db, byte, dw or word");
+		return false;
+	}
+
+	if (i < size && SymTable[i].id == DATA_LIST) {
+		/* decoded by the lexer already, one insert for the line */
+		TokenBuffer& tb = *includes.back().tb;
+		u32 n = SymTable[i++].value;
+		bin.insert(bin.end(), tb.data.begin() + tb.list_bounds[n], tb.data.begin() + tb.list_bounds[n + 1]);
+		(this->*callback)(tb.list_bounds[n + 1] - tb.list_bounds[n]);
+		goto end;
+	}
+
+	/* strings (db only) and expressions, separated by ',' */
+	for (;;) {
+		if (i + 1 >= size || SymTable[i].id == EXTRA_OPERAND) {
+			throwback("error: expected expression in section .%s", name);
+			return false;
+		}
+
+		temp = &SymTable[i];
+		if (temp->id == STRING && width == 1) {
+			i++;
+			for (const char *g = t->text(temp); g != t->text(temp) + temp->length; ++g) {
+				bin.push_back((u8) *g);
+				(this->*callback)(1);
+			}
+		} else {
+			pc = section == DATA_SECTION ? DATA_PC : RODATA_PC;
+			if (!parse_expr(t, i, size, v))
+				return false;
+			kind = width == 2 ? FIXUP_WORD : FIXUP_BYTE;
+			if (!v.known) {
+				fixups.push_back({ (u32) bin.size(), v.node, (u16) pc, kind, (u8) section });
+			} else if (!fixup_fits(kind, v.value)) {
+				throwback("error: value $%X doesn't fit a %s", v.value, width == 2 ? "word" : "byte");
+				return false;
+			}
+			bin.push_back(v.value & 0xFF);
+			if (width == 2) bin.push_back(v.value >> 8 & 0xFF);
+			(this->*callback)(width);
+		}
+
+		if (i + 1 >= size) break;
+		if (SymTable[i].id != EXTRA_OPERAND) {
+			throwback("error: expected ','");
+			return false;
+		}
+		i++;
+	}
+
+end:
+	if (use_end) {
+		bin.push_back('\0');
+		(this->*callback)(1);
+	}
+	return true;
+}
+
+static inline int cmp(const char *str1, u32 len, const char *str2)
+{
+	u32 i;
+	for (i = 0; i < len && str2[i] && tolower(str1[i]) == tolower(str2[i]); ++i);
+	return i < len ? tolower(str2[i])-tolower(str1[i]) : str2[i];
+}
+
+static inline bool is_register(buffer_reader *t, const Sym *s, char r)
+{
+	return s->id == TOKEN && s->length == 1 && toupper(*t->text(s)) == r;
+}
+
+/* Binding strength of the binary operators, 0 for the unary ones */
+static const u8 expr_precedence[] = {
+	0, 0,		/* X_CONST X_SYMBOL */
+	0, 0, 0, 0,	/* X_NEG X_NOT X_LO X_HI */
+	6, 6, 5, 5, 4, 4, 3, 2, 1,
+};
+
+/* false only for a division by zero */
+static bool apply_op(u8 op, s32 a, s32 b, s32& r)
+{
+	switch (op) {
+	case X_NEG: r = -(u32) a; break;
+	case X_NOT: r = ~a; break;
+	case X_LO:  r = a & 0xFF; break;
+	case X_HI:  r = a >> 8 & 0xFF; break;
+	case X_MUL: r = (u32) a * (u32) b; break;
+	case X_DIV: if (!b) return false; r = b == -1 ? -(u32) a : a / b; break;
+	case X_ADD: r = (u32) a + (u32) b; break;
+	case X_SUB: r = (u32) a - (u32) b; break;
+	case X_SHL: r = (u32) b < 32 ? (u32) a << b : 0; break;
+	case X_SHR: r = (u32) b < 32 ? (u32) a >> b : 0; break;
+	case X_AND: r = a & b; break;
+	case X_XOR: r = a ^ b; break;
+	case X_OR:  r = a | b; break;
+	}
+	return true;
+}
+
+static inline u16 value_width(s32 v)
+{
+	return (u32) v <= 0xFF ? ZEROPAGE : ABSOLUTE;
+}
+
+/* A number, a label or equate, * for the current address, a
+   parenthesized expression, or - ~ < > applied to one of those */
+bool Assembler::parse_primary(buffer_reader *t, size_t& i, size_t size, expr_value& v)
+{
+	Sym *s = i + 1 < size ? &SymTable.at(i++) : NULL;
+	Variable var;
+	Label l;
+	u8 op;
+
+	if (!s)
+		goto no_value;
+
+	switch (s->id) {
+	case OPERATOR:
+		if (s->value == X_MUL) {
+			v = { section == TEXT_SECTION ? TEXT_PC : (s32) (section == DATA_SECTION ? DATA_PC : RODATA_PC), 0, ABSOLUTE, true, false };
+			return true;
+		}
+
+		op = s->value == X_SUB ? X_NEG : s->value;
+		if (op > X_HI)
+			goto no_value;
+		if (!parse_primary(t, i, size, v))
+			return false;
+		v.label &= op < X_LO;
+		if (v.known) {
+			apply_op(op, v.value, 0, v.value);
+			v.width = op >= X_LO ? ZEROPAGE : v.width == ABSOLUTE && !v.label ? ABSOLUTE : value_width(v.value);
+		} else {
+			exprs.push_back({ 0, v.node, 0, op });
+			v.node = exprs.size() - 1;
+			v.width = op >= X_LO ? ZEROPAGE : ABSOLUTE;
+		}
+		return true;
+	case INDIRECT_OPEN:
+		if (!parse_expr(t, i, size, v))
+			return false;
+		if (i + 1 >= size || SymTable[i].id != INDIRECT_CLOSE) {
+			throwback("error: expected ')'");
+			return false;
+		}
+		i++;
+		return true;
+	case TOKEN:
+		var.name = l.label = symbols.intern(t->text(s), s->length);
+		if (find_variable(var)) {
+			if (var.known) v = { var.value, 0, (u16) (_NONE + var.type), true, false };
+			else v = { 0, var.node, ABSOLUTE, false, var.label };
+			return true;
+		} else if (find_label(l)) {
+			v = { l.addr, 0, value_width(l.addr), true, true };
+		} else {
+			exprs.push_back({ (s32) l.label, 0, 0, X_SYMBOL });
+			v = { 0, (u32) exprs.size() - 1, ABSOLUTE, false, true };
+		}
+		if (optimize) {
+			grow_flow(l.label);
+			refs[l.label]++;
+			ref_id = l.label;
+		}
+		return true;
+	}
+
+	if (s->id == IMMEDIATE || s->width == ZEROPAGE || s->width == ABSOLUTE) {
+		v = { (s32) s->value, 0, s->id == IMMEDIATE ? (u16) ZEROPAGE : s->width, true, false };
+		return true;
+	}
+
+no_value:
+	throwback("error: expected value");
+	return false;
+}
+
+/* Precedence climbing. Known operands are folded as they combine, a
+   node is only built where one side still names an undefined label. */
+bool Assembler::parse_expr(buffer_reader *t, size_t& i, size_t size, expr_value& v, int min_prec)
+{
+	expr_value rhs;
+	u8 op;
+
+	if (!parse_primary(t, i, size, v))
+		return false;
+
+	while (i + 1 < size && SymTable[i].id == OPERATOR && expr_precedence[op = SymTable[i].value] >= min_prec) {
+		i++;
+		if (!parse_expr(t, i, size, rhs, expr_precedence[op] + 1))
+			return false;
+
+		if (v.known && rhs.known) {
+			if (!apply_op(op, v.value, rhs.value, v.value)) {
+				throwback("error: division by zero");
+				return false;
+			}
+			v.width = (v.width == ABSOLUTE && !v.label) || (rhs.width == ABSOLUTE && !rhs.label) ? ABSOLUTE : value_width(v.value);
+			v.label |= rhs.label;
+		} else {
+			exprs.push_back({ 0, expr_node(v), expr_node(rhs), op });
+			v = { 0, (u32) exprs.size() - 1, ABSOLUTE, false, true };
+		}
+	}
+
+	return true;
+}
+
+u32 Assembler::expr_node(const expr_value& v)
+{
+	if (!v.known)
+		return v.node;
+	exprs.push_back({ v.value, 0, 0, X_CONST });
+	return exprs.size() - 1;
+}
+
+/* Link time, every label is defined by now. missing is the symbol
+   that still isn't, 0 for a division by zero. With guess a label this
+   pass hasn't reached yet is taken from where the last pass put it. */
+bool Assembler::eval_expr(u32 node, s32& v, u32& missing, bool guess)
+{
+	const Expr e = exprs[node];
+	Variable var;
+	Label l;
+	s32 a, b = 0;
+
+	if (e.op == X_CONST) {
+		v = e.value;
+		return true;
+	}
+
+	if (e.op == X_SYMBOL) {
+		var.name = l.label = e.value;
+		if (find_variable(var)) {
+			if (!var.known) return eval_expr(var.node, v, missing, guess);
+			v = var.value;
+		} else if (find_label(l)) v = l.addr;
+		else if (guess && (u32) e.value < last_pass.size() && last_pass[e.value] != NO_VALUE) v = last_pass[e.value];
+		else { missing = e.value; return false; }
+		return true;
+	}
+
+	if (!eval_expr(e.lhs, a, missing, guess) || (e.op >= X_MUL && !eval_expr(e.rhs, b, missing, guess)))
+		return false;
+	if (!apply_op(e.op, a, b, v)) {
+		missing = 0;
+		return false;
+	}
+	return true;
+}
+
+/* node names the symbol id somewhere, how an equate refers to itself */
+bool Assembler::mentions(u32 node, u32 id)
+{
+	const Expr e = exprs[node];
+
+	if (e.op == X_CONST) return false;
+	if (e.op == X_SYMBOL) return (u32) e.value == id;
+	return mentions(e.lhs, id) || (e.op >= X_MUL && mentions(e.rhs, id));
+}
+
+/* v's value as far as this pass or the last one can tell, false if
+   neither has seen all of its labels */
+bool Assembler::guess_value(const expr_value& v, s32& r)
+{
+	u32 missing;
+
+	if (v.known) {
+		r = v.value;
+		return true;
+	}
+
+	guessed = true;
+	return eval_expr(v.node, r, missing, true);
+}
+
+/* Where a jump to target ends up, following the jmps the last pass
+   found there. A jmp loop leads nowhere else, so it stops in it. */
+s32 Assembler::thread_jump(s32 target)
+{
+	s32 start = target;
+
+	guessed = true;
+	for (int hops = 0; hops < 0x10; ++hops) {
+		auto j = std::lower_bound(last_jumps.begin(), last_jumps.end(), target,
+					  [](const Jump& a, s32 addr) { return a.addr < addr; });
+		if (j == last_jumps.end() || j->addr != target || j->target == start)
+			break;
+		target = j->target;
+	}
+
+	return target;
+}
+
+/* Opcode of a branch the known flags always take, 0 if there's none */
+u8 Assembler::taken_branch()
+{
+	for (int i = 0; i < 4; ++i)
+		if (flow.flags_known & branch_flags[i])
+			return i << 6 | !!(flow.flags & branch_flags[i]) << 5 | 0x10;
+	return 0;
+}
+
+static inline void know_flag(flow_state& s, u8 f, bool set)
+{
+	s.flags_known |= f;
+	s.flags = set ? s.flags | f : s.flags & ~f;
+}
+
+static inline u8 nz_of(u8 value)
+{
+	return (value & 0x80) | (value ? 0 : F_Z);
+}
+
+/* What holds on both ways in */
+static flow_state meet(const flow_state& a, const flow_state& b)
+{
+	flow_state m = a;
+
+	if (!a.reached) return b;
+	if (!b.reached) return a;
+
+	m.flags_known = a.flags_known & b.flags_known & ~(a.flags ^ b.flags);
+	m.flags = a.flags & m.flags_known;
+	m.regs_known = a.regs_known & b.regs_known;
+	for (int i = 0; i < 3; ++i)
+		if (a.reg[i] != b.reg[i]) m.regs_known &= ~(1 << i);
+	m.nz = a.nz & b.nz;
+	return m;
+}
+
+/* What's known after this instruction. Constants go through loads,
+   transfers and increments, whatever else the mnemonic writes is
+   forgotten, and nothing falls through a jmp, rts or rti. */
+void Assembler::track(int m, u16 mode, const expr_value& v)
+{
+	u8 *r = flow.reg, value {};
+	int d = -1;
+
+	switch (m) {
+	case M_LDA:
+	case M_LDX:
+	case M_LDY:
+		if (mode == IMMEDIATE && v.known) { d = m - M_LDA; value = v.value; }
+		break;
+	case M_TAX:
+	case M_TAY:
+		if (flow.regs_known & R_A) { d = m == M_TAX ? 1 : 2; value = r[0]; }
+		break;
+	case M_TXA:
+	case M_TYA:
+		if (flow.regs_known & (m == M_TXA ? R_X : R_Y)) { d = 0; value = r[m == M_TXA ? 1 : 2]; }
+		break;
+	case M_INX:
+	case M_DEX:
+		if (flow.regs_known & R_X) { d = 1; value = r[1] + (m == M_INX ? 1 : -1); }
+		break;
+	case M_INY:
+	case M_DEY:
+		if (flow.regs_known & R_Y) { d = 2; value = r[2] + (m == M_INY ? 1 : -1); }
+		break;
+	case M_JMP:
+		/* the vector may point at any label */
+		if (mode == INDIRECT)
+			wild = true;
+		/* fall through */
+	case M_RTS:
+	case M_RTI:
+		flow = {};
+		return;
+	}
+
+	flow.flags_known &= ~mnemonic_flags.writes[m];
+	flow.regs_known &= ~(mnemonic_flags.regs[m] | (mode == ACCUMULATOR ? R_A : 0));
+	if (mnemonic_flags.writes[m] & F_NZ)
+		flow.nz = mnemonic_flags.nz[m] | (mode == ACCUMULATOR ? R_A : 0);
+
+	switch (m) {
+	case M_CLC: case M_SEC: know_flag(flow, F_C, m == M_SEC); break;
+	case M_CLD: case M_SED: know_flag(flow, F_D, m == M_SED); break;
+	case M_CLI: case M_SEI: know_flag(flow, F_I, m == M_SEI); break;
+	case M_CLV: know_flag(flow, F_V, false); break;
+	}
+
+	if (d >= 0) {
+		flow.regs_known |= 1 << d;
+		r[d] = value;
+		flow.flags_known |= F_NZ;
+		flow.flags = (flow.flags & ~F_NZ) | nz_of(value);
+	}
+}
+
+void Assembler::grow_flow(u32 id)
+{
+	if (id < refs.size())
+		return;
+	id = symbols.count() + 1 > id ? symbols.count() + 1 : id + 1;
+	refs.resize(id);
+	direct.resize(id);
+	edges.resize(id);
+	later.resize(id);
+}
+
+/* s flows into the label the instruction at hand jumps to, anything
+   but a bare label leaves the program open to jumps nothing tracks */
+void Assembler::flow_edge(const flow_state& s)
+{
+	Label l;
+
+	if (!bare) {
+		wild = true;
+		return;
+	}
+
+	grow_flow(bare);
+	direct[bare]++;
+	l.label = bare;
+	flow_state& e = find_label(l) ? later[bare] : edges[bare];
+	e = meet(e, s);
+}
+
+void Assembler::enter_label(u32 id)
+{
+	flow_state in = flow;
+
+	if (pass > 1 && !last_wild && id != last_main && id < last_open.size() && !last_open[id]) {
+		grow_flow(id);
+		in = meet(meet(in, edges[id]), last_later[id]);
+	} else {
+		in.reached = false;
+	}
+
+	if (!in.reached)
+		in = {};
+	flow = in;
+	flow.reached = true;
+}
+
+/* Register r already holds value, and N and Z say so */
+bool Assembler::holds(u8 r, u8 value)
+{
+	return (flow.regs_known & r) && flow.reg[r >> 1] == value
+	    && (flow.flags_known & F_NZ) == F_NZ && (flow.flags & F_NZ) == nz_of(value);
+}
+
+/* -report, one line per rewrite of the pass that ends up in the rom */
+void Assembler::report(buffer_reader *t, int rule, const char *what, int m)
+{
+	char line[0x100];
+
+	if (!options.report)
+		return;
+	snprintf(line, sizeof line, "%s:%d: -O %s: %s %s\n", t->name(), t->cur_line(), peep_names[rule], what, mnemonic_names[m]);
+	notes += line;
+}
+
+/* A branch only reaches 128 bytes either way, past that it becomes the
+   inverted branch over a jmp. Falling through tells which way its flag
+   went. */
+void Assembler::encode_branch(u8 code, const expr_value& v)
+{
+	u32 at = site++;
+	s32 target = v.value, th;
+	bool have = guess_value(v, target), exact = v.known;
+	u8 flag = branch_flags[code >> 6];
+	flow_state taken = flow;
+
+	if (at == site_long.size())
+		site_long.push_back(0);
+
+	if (optimize) {
+		know_flag(taken, flag, code & 0x20);
+		flow_edge(taken);
+	}
+
+	#define in_range(to) ((to) - (TEXT_PC + 2) >= -0x80 && (to) - (TEXT_PC + 2) <= 0x7F)
+	if (have && !in_range(target))
+		site_long[at] = 1;
+
+	/* -O: a branch to a jmp goes where that jmp does, if it still reaches */
+	if (have && optimize && (th = thread_jump(target)) != target && (site_long[at] || in_range(th))) {
+		target = th;
+		exact = true;
+		threaded++;
+	}
+
+	if (!site_long[at]) {
+		if (exact) save_instruction(code, 2, target - (TEXT_PC + 2));
+		else save_instruction(code, 2, 0, FIXUP_RELATIVE, v.node);
+	} else {
+		save_instruction(code ^ 0x20, 2, 3);
+		if (exact) save_instruction(0x4C, 3, target);
+		else save_instruction(0x4C, 3, 0, FIXUP_WORD, v.node);
+		long_branches++;
+	}
+	#undef in_range
+
+	/* either form, so what follows doesn't depend on the layout */
+	know_flag(flow, flag, !(code & 0x20));
+}
+
+/* -O: jmp and jsr to a jmp go straight to where it leads, and a jmp whose
+   way the flags already decide becomes a branch when that's no slower,
+   that is when it doesn't cross a page. Like a branch it starts short
+   and only ever grows back into the jmp. */
+void Assembler::encode_jump(int m, const opcode& op, const expr_value& v)
+{
+	s32 target = v.value, th, d;
+	bool have = guess_value(v, target), exact = v.known;
+	u16 addr = TEXT_PC;
+	u32 at;
+	u8 br;
+
+	flow_edge(flow);
+	if (have && (th = thread_jump(target)) != target) {
+		target = th;
+		exact = true;
+		threaded++;
+	}
+
+	if (m == M_JMP) {
+		at = site++;
+		if (at == site_long.size())
+			site_long.push_back(0);
+	}
+
+	if (m == M_JMP && (br = taken_branch())) {
+		d = target - (TEXT_PC + 2);
+		if (have && (d < -0x80 || d > 0x7F || ((TEXT_PC + 2) ^ target) & 0xFF00))
+			site_long[at] = 1;
+
+		if (!site_long[at]) {
+			if (exact) save_instruction(br, 2, d);
+			else save_instruction(br, 2, 0, FIXUP_RELATIVE, v.node);
+			flow = {};
+			shortened++;
+			return;
+		}
+	}
+
+	if (exact) save_instruction(op.code, 3, target);
+	else save_instruction(op.code, 3, 0, FIXUP_WORD, v.node);
+	if (m == M_JMP && have)
+		jumps.push_back({ addr, (u16) target });
+	track(m, ABSOLUTE, v);
+}
+
+/* Whether an operand naming a label further down gets the zero page
+   form, going by where the last pass put that label. Like a branch it
+   starts short, the first pass has nothing to go by and only runs again
+   if one of them turns out not to fit. */
+bool Assembler::fits_zeropage(const expr_value& v)
+{
+	u32 at = site++;
+	s32 value;
+
+	if (at == site_long.size())
+		site_long.push_back(0);
+
+	if (pass == 1) {
+		unsized.push_back(v.node);
+		return true;
+	}
+
+	if (!guess_value(v, value) || (u32) value > 0xFF)
+		site_long[at] = 1;
+	return !site_long[at];
+}
+
+/* After the first pass, true if any operand it took for the zero page
+   ends up past it */
+bool Assembler::widens()
+{
+	u32 missing;
+	s32 v;
+
+	for (u32 node : unsized)
+		if (eval_expr(node, v, missing) && (u32) v > 0xFF)
+			return true;
+	return false;
+}
+
+/* -O: rewrites against the instruction before, true when this one
+   isn't needed at all. A label in between means control can arrive
+   without it, so the one before may only still change when this one
+   stays, which is how a jsr turns into a jmp ahead of a labeled rts. */
+bool Assembler::peephole(buffer_reader *t, int m, u16 mode, const expr_value& v)
+{
+	bool same = !last.label && last.mode == mode && last.known == v.known
+		 && (v.known ? last.value == v.value
+			     : exprs[last.node].op == X_SYMBOL && exprs[v.node].op == X_SYMBOL && exprs[last.node].value == exprs[v.node].value);
+	u8 reg = m == M_LDA ? R_A : m == M_LDX ? R_X : R_Y, f;
+	char what[0x20];
+	bool set;
+
+	/* -undoc: one instruction does both. The read-modify-write ones
+	   touch the operand once where the pair read it twice, so only
+	   ram may be fused, never the hardware registers above $1FFF. */
+	for (const auto& u : fusion_list) {
+		if (!undocumented || last.label || last.m != u.first || m != u.second)
+			continue;
+		if (m == M_TAX || m == M_TXA) {
+			if (!opcodes.at(u.fused, last.mode).bytes)
+				continue;
+		} else if (!same || !opcodes.at(u.fused, mode).bytes
+			|| !(mode == ZEROPAGE || mode == ZEROPAGE_X || (v.known && v.value + (mode == ABSOLUTE_X ? 0xFF : 0) < 0x2000))) {
+			continue;
+		}
+		text_bin[last.at] = opcodes.at(u.fused, last.mode).code;
+		last.m = u.fused;
+		track(m, mode, v);
+		peeps[PEEP_FUSE]++;
+		snprintf(what, sizeof what, "%s before now does", mnemonic_names[u.fused]);
+		report(t, PEEP_FUSE, what, m);
+		return true;
+	}
+
+	switch (m) {
+	case M_RTS:
+		if (last.m != M_JSR)
+			return false;
+		text_bin[last.at] = opcodes.at(M_JMP, ABSOLUTE).code;
+		last.m = M_JMP;
+		peeps[PEEP_TAIL_CALL]++;
+		report(t, PEEP_TAIL_CALL, last.label ? "jsr became jmp before" : "jsr became jmp, removed", m);
+		if (last.label)
+			return false;
+		flow = {};
+		return true;
+	case M_LDA:
+	case M_LDX:
+	case M_LDY:
+		/* the same load again, one of what was just stored from a
+		   register the flags already follow, or a value it holds */
+		if (same && mode == IMMEDIATE && last.m == m) {
+			peeps[PEEP_RELOAD]++;
+			report(t, PEEP_RELOAD, "removed", m);
+			return true;
+		}
+		if (same && mode == ZEROPAGE && last.m == m + M_STA - M_LDA && (flow.nz & reg)) {
+			peeps[PEEP_STORE_LOAD]++;
+			report(t, PEEP_STORE_LOAD, "removed", m);
+			return true;
+		}
+		if (mode != IMMEDIATE || !v.known || !holds(reg, v.value))
+			return false;
+		break;
+	case M_TAX:
+	case M_TAY:
+		if (!(flow.regs_known & R_A) || !holds(m == M_TAX ? R_X : R_Y, flow.reg[0]))
+			return false;
+		break;
+	case M_TXA:
+	case M_TYA:
+		reg = m == M_TXA ? R_X : R_Y;
+		if (!(flow.regs_known & reg) || !holds(R_A, flow.reg[reg >> 1]))
+			return false;
+		break;
+	case M_CLC: case M_SEC:
+	case M_CLD: case M_SED:
+	case M_CLI: case M_SEI:
+	case M_CLV:
+		f = m == M_CLC || m == M_SEC ? F_C : m == M_CLD || m == M_SED ? F_D : m == M_CLI || m == M_SEI ? F_I : F_V;
+		set = m == M_SEC || m == M_SED || m == M_SEI;
+		if (!(flow.flags_known & f) || !!(flow.flags & f) != set)
+			return false;
+		peeps[PEEP_KNOWN_FLAG]++;
+		report(t, PEEP_KNOWN_FLAG, "removed", m);
+		return true;
+	default:
+		return false;
+	}
+
+	peeps[PEEP_KNOWN_VALUE]++;
+	report(t, PEEP_KNOWN_VALUE, "removed", m);
+	return true;
+}
+
+void Assembler::note_insn(int m, u16 mode, const expr_value& v, u32 at)
+{
+	last = { at, (u8) m, mode, v.value, v.node, v.known, false };
+}
+
+/* The one operand classifier every mnemonic goes through. Reads what
+   follows the mnemonic into an addressing mode and an expression, its
+   width picks between the zero page and absolute forms. */
+bool Assembler::parse_operand(buffer_reader *t, const Sym *x, size_t& i, size_t size, u16& mode, expr_value& v)
+{
+	int m = x->value;
+	size_t mark;
+	Sym *s;
+
+	#define peek() (i + 1 < size ? &SymTable.at(i) : NULL)
+	#define next() (i + 1 < size ? &SymTable.at(i++) : NULL)
+	v = { 0, 0, _NONE, true, false };
+	bare = 0;
+
+	if (!(s = peek())) {
+		if (opcodes.at(m, IMPLIED).bytes) mode = IMPLIED;
+		else if (opcodes.at(m, ACCUMULATOR).bytes) mode = ACCUMULATOR;
+		else goto no_value;
+		return true;
+	}
+
+	if (s->id == IMMEDIATE || s->id == IMMEDIATE_MARK) {
+		if (s->id == IMMEDIATE_MARK) i++;
+		mode = IMMEDIATE;
+		mark = i;
+		if (!parse_expr(t, i, size, v))
+			return false;
+		/* the lexer already warned about a lone #$ or #% literal */
+		if (v.known && (v.value < -0x80 || v.value > 0xFF) && !(s->id == IMMEDIATE && i == mark + 1))
+			throwback("warning: immediate value overflow");
+		return true;
+	}
+
+	if (is_register(t, s, 'A') && opcodes.at(m, ACCUMULATOR).bytes) {
+		i++;
+		mode = ACCUMULATOR;
+		return true;
+	}
+
+	if (s->id == INDIRECT_OPEN) {
+		mark = i++;
+		if (!parse_expr(t, i, size, v))
+			return false;
+
+		if ((s = next()) && s->id == INDIRECT_CLOSE) {
+			if (!(s = peek())) {
+				mode = INDIRECT;
+				return true;
+			}
+
+			if (s->id == EXTRA_OPERAND) {
+				i++;
+				if (!(s = next()) || !is_register(t, s, 'Y')) {
+					throwback("error: expected Y register");
+					return false;
+				}
+				mode = INDIRECT_Y;
+				return true;
+			}
+
+			/* (SIZE*2)-1 and the like, the parentheses only group */
+			i = mark;
+		} else if (s && s->id == EXTRA_OPERAND) {
+			if (!(s = next()) || !is_register(t, s, 'X')) {
+				throwback("error: expected X register");
+				return false;
+			}
+			if (!(s = next()) || s->id != INDIRECT_CLOSE) {
+				throwback("error: expected ')'");
+				return false;
+			}
+			mode = INDIRECT_X;
+			return true;
+		} else {
+			throwback("error: expected ')'");
+			return false;
+		}
+	}
+
+	/* a lone label, where -O's dataflow can follow a jump */
+	mark = i;
+	ref_id = 0;
+	if (!parse_expr(t, i, size, v))
+		return false;
+	bare = i == mark + 1 ? ref_id : 0;
+	mode = v.width;
+
+	if (!(s = next()))
+		return true;
+	if (s->id != EXTRA_OPERAND)
+		goto no_comma;
+
+	/* ZEROPAGE_X and ABSOLUTE_X follow their base mode, then _Y */
+	if ((s = next()) && is_register(t, s, 'X')) {
+		mode += 1;
+	} else if (s && is_register(t, s, 'Y')) {
+		mode += 2;
+	} else {
+		throwback("error: expected X or Y registers");
+		return false;
+	}
+
+	return true;
+	#undef peek
+	#undef next
+
+no_comma:
+	throwback("error: expected ','");
+	return false;
+no_value:
+	throwback("error: expected value on %.*s", (int) x->length, t->text(x));
+	return false;
+}
+
+/* Classify the operand, then it's a lookup in the opcode matrix. A zero
+   page form the mnemonic lacks falls back to its absolute twin. */
+bool Assembler::encode_instruction(buffer_reader *t, const Sym *x, size_t& i, size_t size)
+{
+	int m = x->value;
+	u32 at = text_bin.size();
+	u16 mode;
+	expr_value v;
+
+	if (!opcodes.known[m]) {
+		throwback("error: no such instruction '%.*s'", (int) x->length, t->text(x));
+		return false;
+	}
+	if (m >= M_UNDOCUMENTED && !undocumented) {
+		throwback("error: %.*s is undocumented, -undoc allows it", (int) x->length, t->text(x));
+		return false;
+	}
+
+	if (!parse_operand(t, x, i, size, mode, v))
+		return false;
+
+	if ((mode == ZEROPAGE || mode == ABSOLUTE) && opcodes.at(m, RELATIVE).bytes) {
+		encode_branch(opcodes.at(m, RELATIVE).code, v);
+		if (optimize) note_insn(m, RELATIVE, v, at);
+		return true;
+	}
+
+	if (!v.known && v.label && mode >= ABSOLUTE && mode <= ABSOLUTE_Y
+	 && opcodes.at(m, mode + ZEROPAGE - ABSOLUTE).bytes && fits_zeropage(v))
+		mode += ZEROPAGE - ABSOLUTE;
+
+	if (!opcodes.at(m, mode).bytes && mode >= ZEROPAGE && mode <= ZEROPAGE_Y)
+		mode += ABSOLUTE - ZEROPAGE;
+
+	const opcode& op = opcodes.at(m, mode);
+	if (!op.bytes) {
+		if ((mode == ABSOLUTE_X || mode == ZEROPAGE_X) && opcodes.at(m, mode + 1).bytes) {
+			throwback("error: expected Y register");
+		} else if ((mode == ABSOLUTE_Y || mode == ZEROPAGE_Y) && opcodes.at(m, mode - 1).bytes) {
+			throwback("error: expected X register");
+		} else {
+			throwback("error: bad addressing mode on %.*s", (int) x->length, t->text(x));
+		}
+		return false;
+	}
+
+	if (op.bytes == 2 && mode != IMMEDIATE && v.known && (v.value < -0x80 || v.value > 0xFF)) {
+		throwback("error: zero page operand $%X out of range", v.value);
+		return false;
+	}
+
+	if (optimize && peephole(t, m, mode, v))
+		return true;
+
+	if (optimize && mode == ABSOLUTE && (m == M_JMP || m == M_JSR)) {
+		encode_jump(m, op, v);
+		note_insn(m, mode, v, at);
+		return true;
+	}
+
+	if (v.label && mode >= ZEROPAGE && mode <= ZEROPAGE_Y && opcodes.at(m, mode + ABSOLUTE - ZEROPAGE).bytes) {
+		const opcode& wide = opcodes.at(m, mode + ABSOLUTE - ZEROPAGE);
+		zp_operands++;
+		zp_bytes += wide.bytes - op.bytes;
+		zp_cycles += wide.cycles - op.cycles;
+	}
+
+	save_instruction(op.code, op.bytes, v.value, v.known ? 0 : op.bytes == 2 ? FIXUP_BYTE : FIXUP_WORD, v.node);
+	track(m, mode, v);
+	if (optimize) note_insn(m, mode, v, at);
+	return true;
+}
+
+bool Assembler::regex(buffer_reader *t)
+{
+	size_t i {};
+	size_t size {};
+	bool success {};
+	bool finished_instruction = false;
+	read_sym()->length = 0;
+	read_sym()->id = NONE;
+	SymTable.push_back(*read_sym());
+	i = 0;
+
+	size = SymTable.size();
+	while (1) {
+		if (i>=size) break;
+		Sym *x = &SymTable.at(i++);
+		Sym *temp {};
+
+		if (x->id == NONE)
+			break;
+
+		if (x->id == TOKEN) {
+			if (finished_instruction) {
+				throwback("error: more token parsing before instruction %.*s", (int) x->length, t->text(x));
+				goto fail;
+			}
+
+			if (i + 1 < size) {
+				temp = &SymTable.at(i++);
+
+				if (temp->id == LABEL) {
+					label.label = symbols.intern(t->text(x), x->length);
+					if (section == TEXT_SECTION) { label.addr = TEXT_PC; enter_label(label.label); last.label = true; }
+					else if (section == DATA_SECTION) { label.addr = DATA_PC; }
+					else if (section == READ_ONLY_SECTION) { label.addr = RODATA_PC; }
+					label.section = section;
+					if (!save_label(label)) {
+						throwback("conflicting types for %.*s", (int) x->length, t->text(x));
+						goto fail;
+					}
+				} else if (temp->id == ASSIGNMENT) {
+					expr_value v;
+					Variable var;
+
+					finished_instruction = true;
+					if (!parse_expr(t, i, size, v))
+						goto fail;
+					var.name = symbols.intern(t->text(x), x->length);
+					if (!v.known && mentions(v.node, var.name)) {
+						throwback("error: %.*s is defined in terms of itself", (int) x->length, t->text(x));
+						goto fail;
+					}
+
+					var.value = v.value;
+					var.type = MODE(v.width);
+					var.known = v.known;
+					var.label = v.label;
+					var.node = v.node;
+					if (!save_variable(var)) {
+						throwback("conflicting types for %.*s", (int) x->length, t->text(x));
+						goto fail;
+					}
+				} else {
+					i--;
+					goto instruction_parse;
+				}
+			} else {
+			instruction_parse:
+				if (section == TEXT_SECTION) {
+					finished_instruction = true;
+					if (!encode_instruction(t, x, i, size))
+						goto fail;
+				} else if (section == DATA_SECTION) {
+					finished_instruction = true;
+					if (x->id == TOKEN) {
+						if (!add_data_byte(x, t, i, &Assembler::ADD_DATA_PC, data_bin, 0)) {
+							fprintf(diag, "FA");
+							goto fail;
+						} else {
+						}
+					} else {
+						throwback("error: expected value or label on .data");
+						goto fail;
+					}
+				} else if (section == READ_ONLY_SECTION) {
+					finished_instruction = true;
+					if (x->id == TOKEN) {
+						if (!add_data_byte(x, t, i, &Assembler::ADD_RODATA_PC, rodata_bin, 1))
+							goto fail;
+					} else {
+						throwback("error: expected value or label on .rodata");
+						goto fail;
+					}
+				} else {
+					throwback("error: bad section");
+					goto fail;
+				}
+			}
+		} else {
+			throwback("error: failed parsing '%.*s'", (int) x->length, t->text(x));
+			goto fail;
+		}
+	}
+
+	success = true;
+fail:
+	SymTable.clear();
+	return success;
+}
+
+
+void Assembler::end_line(buffer_reader *t, TokenBuffer& tb)
+{
+	if (parse_line) {
+		tb.lines.push_back(tb.count);
+		parse_line = false;
+	}
+}
+
+/* db/byte/dw/word lists are decoded right here in one pass over the
+   buffer and kept as a single DATA_LIST token. Anything out of the
+   ordinary (labels, overflowing or malformed values, odd strings) gives
+   up and the line is lexed token by token, so it reports as before. */
+bool Assembler::lex_data_list(buffer_reader *t, TokenBuffer& tb)
+{
+	const char *p, *s, *end;
+	size_t mark = tb.data.size();
+	u32 k = tb.count - 1, n, v;
+	u8 width;
+	Sym list {};
+
+	if (tb.kinds[k] != TOKEN || (k != tb.lines.back() && tb.kinds[k - 1] != LABEL))
+		return false;
+	s = t->data() + tb.offsets[k];
+	n = tb.lengths[k];
+	if (!cmp(s, n, "db") || !cmp(s, n, "byte")) width = 1;
+	else if (!cmp(s, n, "dw") || !cmp(s, n, "word")) width = 2;
+	else return false;
+
+	for (p = t->cursor() + 1;;) {
+		while (is_blank(*p)) ++p;
+		if (*p == '"') {
+			if (width != 1) goto slow;
+			for (s = ++p; *p && *p != '"' && *p != '\n'; ++p);
+			if (*p != '"') goto slow;
+			tb.data.insert(tb.data.end(), s, p++);
+		} else {
+			/* anything wider than the list is left to the slow path,
+			   which reports it */
+			v = 0;
+			if (*p == '$') {
+				for (s = ++p; is_hex_mask(*p) && p - s < 2 * width; ++p) v = v << 4 | (isdigit(*p) ? *p - '0' : tolower(*p) - 'a' + 10);
+				if (p == s || is_hex_mask(*p)) goto slow;
+			} else if (*p == '%') {
+				for (s = ++p; (*p == '0' || *p == '1') && p - s < 8 * width; ++p) v = v << 1 | (*p == '1');
+				if (p == s || is_hex_mask(*p)) goto slow;
+			} else if (isdigit(*p)) {
+				for (s = p; isdigit(*p) && p - s < 5; ++p) v = v * 10 + (*p - '0');
+				if (isdigit(*p) || v > (width == 1 ? 0xFFu : 0xFFFFu)) goto slow;
+			} else {
+				goto slow;
+			}
+
+			tb.data.push_back(v & 0xFF);
+			if (width == 2) tb.data.push_back(v >> 8 & 0xFF);
+		}
+
+		end = p;
+		while (is_blank(*p)) ++p;
+		if (*p == ',') { ++p; continue; }
+		if (!*p || *p == '\n' || *p == ';') break;
+		goto slow;
+	}
+
+	list.offset = t->tell() + 1;
+	list.length = end - t->data() - list.offset;
+	list.id = DATA_LIST;
+	list.value = tb.list_bounds.size() - 1;
+	tb.list_bounds.push_back(tb.data.size());
+	tb.push(list);
+	lex_tokens++;
+
+	/* a trailing comment is left for the main loop */
+	t->skip(p - t->cursor());
+	return true;
+slow:
+	tb.data.resize(mark);
+	return false;
+}
+
+/* Lexes whatever the reader has ready, always stops at a line start
+   unless the input ended */
+void Assembler::lex_lines(buffer_reader *t, TokenBuffer& tb) {
+	while ((c = t->read_buffer()) != '\0') {
+
+		if (c == '\n') {
+			end_line(t, tb);
+
+			/* Skip the whole run of blank lines in one go */
+			t->skip(scan.blank_lines(t->cursor()));
+			c = t->read_buffer();
+
+			fast_skip = 0;
+		}
+
+		skip_whitespace(t);
+		if (c == '\0') { break; }
+		if (c == '\n') { continue; }
+
+		if (skip_comment(t, ';')) {
+
+		} else if (c == '.' && (!parse_line || tb.kinds[tb.lines.back()] == DIRECTIVE)) {
+			/* Some assemblers doesn't support this i guess?
+			   skip_whitespace ...*/
+			t->step_buffer();
+			skip_whitespace(t);
+			save_sym(t, tb);
+			if (parse_line) tb.kinds[tb.count - 1] = DIRECTIVE;
+		} else {
+			u32 n = tb.count;
+			angle_strings = parse_line && tb.kinds[tb.lines.back()] == DIRECTIVE;
+			save_sym(t, tb);
+			if (tb.count != n && lex_data_list(t, tb)) continue;
+		}
+
+		t->step_buffer();
+	}
+
+	end_line(t, tb);
+}
+
+/* First phase: the whole file into a flat token buffer, one entry in
+   tb.lines per non empty line. Streamed input is lexed as it arrives. */
+void Assembler::lex_file(buffer_reader *t, TokenBuffer& tb) {
+	t->seek(0);
+	tb.clear();
+	/* instruction dense source runs about 5 bytes a token, commented
+	   source far more, push() doubles it when that's not enough */
+	tb.reserve(t->length() / 8 + 0x10);
+	tb.lines.push_back(0);
+
+	do {
+		lex_lines(t, tb);
+	} while (t->fill());
+
+	if (t->is_fail()) {
+		throwback("error: read error");
+		errs++;
+	}
+}
+
+/* Second phase: walk the token buffer a line at a time. Returns true
+   when an include interrupts the walk, the frame then holds where to
+   resume. */
+bool Assembler::parse_tokens(include_frame& f) {
+	buffer_reader *t = &f.src->t;
+	TokenBuffer& tb = *f.tb;
+	u32 i, first, end;
+
+	for (; f.line + 1 < tb.lines.size(); ++f.line, f.tok = 0) {
+		first = tb.lines[f.line];
+		end = tb.lines[f.line + 1];
+		t->seek(tb.offsets[first]);
+
+		if (tb.kinds[first] == DIRECTIVE) {
+			flow = {};
+			flow.reached = true;
+			last = {};
+			for (i = f.tok ? f.tok : first; i < end; ++i) {
+				if (tb.kinds[i] != DIRECTIVE) continue;
+				preprocessor(t, tb, i, end);
+				if (pending_include) {
+					f.tok = i + 1;
+					return true;
+				}
+			}
+			continue;
+		}
+
+		for (i = first; i < end; ++i) {
+			SymTable.push_back(tb.at(i));
+		}
+
+		if (!regex(t)) {
+			errs++;
+		}
+
+#ifdef USE_ERRORS
+#define MAX_ERRORS 3
+		if (errs > MAX_ERRORS) {
+			break;
+		}
+#endif
+	}
+
+	return false;
+}
+
+/* Queues every file this one names so they load while it's parsed */
+void Assembler::prefetch_includes(buffer_reader *t, TokenBuffer& tb)
+{
+	Sym s;
+
+	for (u32 i = 0; i + 1 < tb.count; ++i) {
+		if (tb.kinds[i] != DIRECTIVE || tb.kinds[i + 1] != STRING) continue;
+		s = tb.at(i);
+		if (sym_is(t, &s, "include") || sym_is(t, &s, "import") || sym_is(t, &s, "inc")
+		 || sym_is(t, &s, "incbin") || sym_is(t, &s, "chrbin"))
+			sources.prefetch(std::string(t->data() + tb.offsets[i + 1], tb.lengths[i + 1]));
+	}
+}
+
+/* Walks the include stack without recursion, so the nesting depth is
+   only bounded by memory */
+void Assembler::compile_file(source_file *root) {
+	double start;
+
+	includes.push_back({ root, NULL, 0, 0 });
+	while (!includes.empty()) {
+		include_frame& f = includes.back();
+
+		if (!f.tb) {
+			include_count += pass == 1;
+			f.src->included = true;
+			if ((f.tb = sources.tokens(f.src))) {
+				token_hits += pass == 1;
+			} else {
+				start = now_ms();
+				f.tb = mem.make<TokenBuffer>(&mem);
+				lex_file(&f.src->t, *f.tb);
+				lex_ms += now_ms() - start;
+				sources.cache(f.src, f.tb);
+				prefetch_includes(&f.src->t, *f.tb);
+			}
+		}
+
+		start = now_ms();
+		bool descend = parse_tokens(f);
+		parse_ms += now_ms() - start;
+
+		if (descend) {
+			includes.push_back({ pending_include, NULL, 0, 0 });
+			pending_include = NULL;
+			continue;
+		}
+
+		includes.pop_back();
+	}
+}
+
+#define temp 0x80
+#define MAX_INSTRUCTIONS temp
+
+bool Assembler::check_errors()
+{
+	if (errs) {
+		return true;
+	}
+
+	return false;
+}
+
+int Assembler::compile_assembler(const char *file)
+{
+	int rv;
+
+	source_file *g = sources.load(file);
+	rv = 1;
+	if (!g) {
+		fprintf(diag, "%s: No such file or directory %s\n", prog, file);
+		errs++;
+		goto err;
+	}
+
+	compile_file(g);
+	if (!errs && (guessed || widens()))
+		relax(g);
+	if (!errs)
+		fputs(notes.c_str(), diag);
+	rv = 0;
+
+err:
+	sources.release();
+	g = NULL;
+
+	if (check_errors()) {
+		fprintf(diag, "%s: %s has occured\n", prog, errs<=1?"An error":"Multiple errors");
+		return 0xFF;
+	}
+
+	return rv;
+}
+
+/* Back to before the first line for another pass over the same tokens.
+   Symbols stay interned, so their ids carry over. */
+void Assembler::rewind()
+{
+	TEXT_PC = 0xC000;
+	DATA_PC = RODATA_PC = 0;
+	text_bin.clear();
+	data_bin.clear();
+	rodata_bin.clear();
+	section = TEXT_SECTION;
+	mapper_type = NROM_MAPPER_TYPE;
+	oldpc = TEXT_PC;
+	chr_taken = false;
+
+	prg_rom_size = options.prg_rom_size;
+	chr_rom_size = options.chr_rom_size;
+	mirroring = options.mirroring;
+	battery_backed = options.battery_backed;
+	trainer = options.trainer;
+	main_reloc = options.main_reloc;
+
+	fixups.clear();
+	exprs.clear();
+	labels.clear();
+	variables.clear();
+	std::fill(label_index.begin(), label_index.end(), 0);
+	std::fill(variable_index.begin(), variable_index.end(), 0);
+	sources.rewind();
+
+	site = 0;
+	guessed = optimize;
+	jumps.clear();
+	long_branches = threaded = shortened = 0;
+	zp_operands = zp_bytes = zp_cycles = 0;
+
+	flow = {};
+	flow.reached = true;
+	edges.assign(refs.size(), flow_state {});
+	later.assign(refs.size(), flow_state {});
+	std::fill(refs.begin(), refs.end(), 0);
+	std::fill(direct.begin(), direct.end(), 0);
+	wild = false;
+	notes.clear();
+	last = {};
+	std::fill(peeps, peeps + PEEP_RULES, 0);
+}
+
+/* Where this pass put every symbol and jmp, true if anything moved
+   since the last pass */
+bool Assembler::settle()
+{
+	bool moved;
+
+	settled.assign(symbols.count() + 1, NO_VALUE);
+	for (auto& l : labels) settled[l.label] = l.addr;
+	for (auto& v : variables) settled[v.name] = v.value;
+	std::sort(jumps.begin(), jumps.end(), [](const Jump& a, const Jump& b) {
+		return a.addr != b.addr ? a.addr < b.addr : a.target < b.target;
+	});
+
+	moved = settled != last_pass || jumps.size() != last_jumps.size()
+	     || !std::equal(jumps.begin(), jumps.end(), last_jumps.begin(), [](const Jump& a, const Jump& b) {
+			return a.addr == b.addr && a.target == b.target;
+		});
+	settled.swap(last_pass);
+	jumps.swap(last_jumps);
+
+	/* what the dataflow of the next pass goes by */
+	grow_flow(symbols.count());
+	later.swap(last_later);
+	last_open.resize(refs.size());
+	for (u32 id = 0; id < refs.size(); ++id)
+		last_open[id] = refs[id] != direct[id];
+	last_wild = wild;
+	for (auto& v : variables)
+		if (direct[v.name]) last_wild = true;
+	last_main = symbols.find(main_reloc.data(), main_reloc.size());
+	return moved;
+}
+
+/* The first pass already reported everything, so later ones write
+   their diagnostics aside and only show them if they fail */
+void Assembler::relax(source_file *root)
+{
+	FILE *out = diag, *aside;
+	char *text {};
+	size_t n {};
+
+	while (settle()) {
+		if (pass == MAX_PASSES) {
+			fprintf(out, "%s: branches still move after %d passes\n", prog, MAX_PASSES);
+			errs++;
+			break;
+		}
+
+		pass++;
+		aside = open_memstream(&text, &n);
+		diag = aside ? aside : out;
+		rewind();
+		compile_file(root);
+		diag = out;
+
+		if (aside) {
+			fclose(aside);
+			if (errs) fwrite(text, 1, n, out);
+			free(text);
+			text = NULL;
+		}
+
+		if (errs || !guessed)
+			break;
+	}
+}
+
+void Assembler::print_stats()
+{
+	fprintf(diag, "stats: lexer %llu tokens, %llu heap allocations\n", lex_tokens, lex_allocs);
+	fprintf(diag, "stats: includes %llu, token cache hits %llu, .once skips %llu\n", include_count, token_hits, once_skips);
+	fprintf(diag, "stats: %u symbols interned in %zu bytes\n", symbols.count(), symbols.bytes());
+	fprintf(diag, "stats: arena %llu allocations, %llu chunks, peak %zu bytes\n",
+		mem.allocations(), mem.chunk_count(), mem.peak_bytes());
+	fprintf(diag, "stats: %u passes, %llu long branches, %llu jumps threaded, %llu jmps shortened\n",
+		pass, long_branches, threaded, shortened);
+	fprintf(diag, "stats: %llu label operands in the zero page, %llu bytes and %llu cycles saved\n",
+		zp_operands, zp_bytes, zp_cycles);
+	fprintf(diag, "stats: peephole");
+	for (int i = 0; i < PEEP_RULES; ++i)
+		fprintf(diag, "%s %s %llu", i ? "," : "", peep_names[i], peeps[i]);
+	fprintf(diag, "\n");
+	fprintf(diag, "stats: load %.3f ms, lex %.3f ms, parse %.3f ms, link %.3f ms\n", sources.load_ms, lex_ms, parse_ms, link_ms);
+}
+
+/* Resolves the fixups and lays out the iNES image */
+int Assembler::link(std::vector<u8>& rom)
+{
+	bool found_start {};
+	u32 main_id {};
+	std::string rodata_mask {};
+	bool rv {};
+	u32 prg_capacity {};
+	u32 chr_capacity {};
+	struct iNes hdr;
+
+	for (auto& x : rodata_bin) rodata_mask += x;
+
+	main_id = symbols.find(main_reloc.data(), main_reloc.size());
+	for (auto& g : labels) {
+		if (g.section == READ_ONLY_SECTION) {
+			//printf("<%s:$%04X> \"%s\"; RODATA\n", symbols.name(g.label), g.addr, rodata_mask.c_str()+g.addr);
+		} else if (g.section == TEXT_SECTION) {
+			if (g.label == main_id) found_start = true;
+		}
+	}
+
+	if (!found_start) {
+		fprintf(diag, "<nooblinker:$%04X> undefined reference to '%s'\n", TEXT_PC, main_reloc.c_str());
+		return 1;
+	}
+
+	prg_capacity = 0x4000 * prg_rom_size;
+	chr_capacity = 0x2000 * chr_rom_size;
+	link_ms = now_ms();
+	for (auto& f : fixups) {
+		arena_vector<u8>& bin = f.section == TEXT_SECTION ? text_bin : f.section == DATA_SECTION ? data_bin : rodata_bin;
+		u32 missing;
+		s32 v;
+
+		if (!eval_expr(f.expr, v, missing)) {
+			if (missing) fprintf(diag, "<nooblinker:$%04X> undefined reference label %s\n", f.addr, symbols.name(missing));
+			else fprintf(diag, "<nooblinker:$%04X> division by zero\n", f.addr);
+			rv = 1;
+		} else if (!fixup_fits(f.kind, v)) {
+			fprintf(diag, "<nooblinker:$%04X> value $%X doesn't fit a %s\n", f.addr, v, f.kind == FIXUP_WORD ? "word" : "byte");
+			rv = 1;
+		} else if (f.kind == FIXUP_RELATIVE && (v - (f.addr + 2) < -0x80 || v - (f.addr + 2) > 0x7F)) {
+			fprintf(diag, "<nooblinker:$%04X> branch to $%04X out of range\n", f.addr, v);
+			rv = 1;
+		} else {
+			if (f.kind == FIXUP_RELATIVE) v -= f.addr + 2;
+			bin[f.at] = v & 0xFF;
+			if (f.kind == FIXUP_WORD) bin[f.at + 1] = v >> 8 & 0xFF;
+		}
+	}
+
+	link_ms = now_ms() - link_ms;
+
+	if (text_bin.size() > prg_capacity) {
+		fprintf(diag, "<nooblinker:$%04X> program is $%zX bytes but PRG-ROM only holds $%X\n", TEXT_PC, text_bin.size(), prg_capacity);
+		rv = 1;
+	}
+
+	if (rv) return 1;
+
+	text_bin.resize(prg_capacity, 0x00);
+
+	if (chr_capacity && DATA_PC != chr_capacity) {
+		fprintf(diag, "%s: warning: filling $00's in data pc from $%04X 0's based on CHR-ROM size\n", prog, DATA_PC);
+		for (; DATA_PC < chr_capacity; ++DATA_PC) { data_bin.push_back(0); }
+	}
+
+	memset((void *) &hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, "\x4e\x45\x53\x1a", 4);
+	hdr.prg_rom_size = prg_rom_size;
+	hdr.chr_rom_size = chr_rom_size;
+	hdr.mapper_nr |= mirroring & 1;
+	hdr.mapper_nr |= (mapper_type & 0xF) << 4;
+	hdr.mapper_2_0_nr |= (mapper_type & 0xF0) >> 4;
+
+	if (data_bin.size() < DATA_PC) data_bin.resize(DATA_PC, 0x00);
+	rom.assign((u8 *) &hdr, (u8 *) &hdr + sizeof hdr);
+	rom.insert(rom.end(), text_bin.begin(), text_bin.end());
+	rom.insert(rom.end(), data_bin.begin(), data_bin.begin() + DATA_PC);
+	return 0;
+}
+
+int Assembler::assemble(const char *file, std::vector<u8>& rom)
+{
+	int rv = compile_assembler(file) || link(rom) ? 1 : 0;
+
+	if (show_stats) print_stats();
+	return rv;
+}
+
+void Assembler::export_symbols(std::vector<nesasm_symbol>& out)
+{
+	for (auto& l : labels)
+		out.push_back({ symbols.name(l.label), l.addr, NESASM_LABEL, l.section });
+	for (auto& v : variables) {
+		s32 value = v.value;
+		u32 missing;
+
+		if (!v.known && !eval_expr(v.node, value, missing))
+			value = 0;
+		out.push_back({ symbols.name(v.name), (u16) value, NESASM_VARIABLE, 0 });
+	}
+}
+
+nesasm_result nesasm_assemble(const std::string& source, const nesasm_options& opt, const nesasm_resolver& resolve)
+{
+	nesasm_result r {};
+	char *text {};
+	size_t n {};
+	FILE *diag = open_memstream(&text, &n);
+
+	r.status = 1;
+	if (!diag) return r;
+
+	{
+		Assembler as(opt);
+		as.diag = diag;
+		as.resolve_with(resolve ? resolve : [](const char *, std::string&) { return false; });
+		as.add_source(opt.name, source);
+		r.status = as.assemble(opt.name, r.rom);
+		as.export_symbols(r.symbols);
+	}
+
+	fclose(diag);
+	r.diagnostics.assign(text, n);
+	free(text);
+	if (r.status) r.rom.clear();
+	return r;
+}
+
+int nesasm_assemble_file(const char *file, const char *object, const nesasm_options& opt)
+{
+	Assembler as(opt);
+	std::vector<u8> rom;
+	FILE *out;
+	int rv;
+
+	if ((rv = as.assemble(file, rom)))
+		return rv;
+
+	out = strcmp(object, "-") ? fopen(object, "wb+") : stdout;
+	if (!out) {
+		fprintf(opt.diag, "%s: can't write %s\n", opt.prog, object);
+		return 1;
+	}
+
+	fwrite(rom.data(), 1, rom.size(), out);
+	fflush(out);
+	if (out != stdout) fclose(out);
+	return 0;
+}
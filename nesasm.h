@@ -0,0 +1,61 @@
+#ifndef NESASM_H
+#define NESASM_H
+
+/*
+ * The assembler as a library, libnesasm.a. Source text goes in, the iNES
+ * image, the diagnostics and the symbol table come out, all in memory.
+ * Each call is an assembly of its own, any number can run at once.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+struct nesasm_options {
+	const char *name = "<input>";	// of the source, for diagnostics
+	const char *main_reloc = "_main";
+	uint8_t prg_rom_size = 1, chr_rom_size = 1;
+	bool mirroring {}, battery_backed {}, trainer {};
+	bool show_stats {};
+	bool optimize {};	// -O, jump threading, jmp to branch and the peephole
+	bool report {};		// -report, a line for each rewrite -O made
+	bool undocumented {};	// -undoc, the stable undocumented opcodes
+
+	/* Only used by nesasm_assemble_file */
+	const char *prog = "nesasm";
+	FILE *diag = stdout;
+};
+
+/* Hands over the contents of a path named by .include, .incbin or
+   .chrbin, false if there's no such file */
+typedef std::function<bool (const char *path, std::string& text)> nesasm_resolver;
+
+enum { NESASM_LABEL, NESASM_VARIABLE };
+
+struct nesasm_symbol {
+	std::string name;
+	uint16_t value;
+	uint8_t kind;
+	uint8_t section;	// of a label
+};
+
+struct nesasm_result {
+	int status;		// 0 once rom holds a complete image
+	std::vector<uint8_t> rom;
+	std::string diagnostics;
+	std::vector<nesasm_symbol> symbols;
+};
+
+/* Never touches the filesystem, every include goes through resolve and
+   without one no include is found */
+nesasm_result nesasm_assemble(const std::string& source, const nesasm_options& opt = {}, const nesasm_resolver& resolve = {});
+
+/* What the command line does, file (- for stdin) to object (- for stdout) */
+int nesasm_assemble_file(const char *file, const char *object, const nesasm_options& opt);
+
+/* Bumped by the command line's counting operator new for -stats, stays 0
+   in programs that don't replace it */
+extern thread_local unsigned long long nesasm_heap_allocs;
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+/*
+ * 6502 mnemonics. Tokens are case folded and looked up once in the lexer
+ * through a perfect hash built at compile time, the parser only ever
+ * sees the dense id in Sym::value (0 for anything that isn't one).
+ */
+#define MNEMONICS(g)								\
+	g(ADC) g(AND) g(ASL) g(BCC) g(BCS) g(BEQ) g(BIT) g(BMI)			\
+	g(BNE) g(BPL) g(BRK) g(BVC) g(BVS) g(CLC) g(CLD) g(CLI)			\
+	g(CLV) g(CMP) g(CPX) g(CPY) g(DEC) g(DEX) g(DEY) g(EOR)			\
+	g(INC) g(INX) g(INY) g(JMP) g(JSR) g(LDA) g(LDX) g(LDY)			\
+	g(LSR) g(NOP) g(ORA) g(PHA) g(PHP) g(PLA) g(PLP) g(ROL)			\
+	g(ROR) g(RTI) g(RTS) g(SBC) g(SEC) g(SED) g(SEI) g(STA)			\
+	g(STX) g(STY) g(TAX) g(TAY) g(TSX) g(TXA) g(TXS) g(TYA)			\
+	/* spasm */								\
+	g(SYSCALL) g(BREAK)							\
+	/* undocumented, only with -undoc */					\
+	g(ALR) g(ANC) g(ARR) g(AXS) g(DCP) g(ISC) g(LAX) g(RLA)			\
+	g(RRA) g(SAX) g(SLO) g(SRE)
+
+#define MNEMONIC_ENUM(m) M_##m,
+enum {
+	M_NONE,
+	MNEMONICS(MNEMONIC_ENUM)
+	MNEMONIC_COUNT
+};
+#undef MNEMONIC_ENUM
+
+/* The stable undocumented opcodes of the 2A03 come last */
+#define M_UNDOCUMENTED M_ALR
+
+#define MNEMONIC_NAME(m) #m,
+static constexpr const char *mnemonic_names[] = { "", MNEMONICS(MNEMONIC_NAME) };
+#undef MNEMONIC_NAME
+
+/* First three characters and the length in one word, the multiplier was
+   searched for offline and the static_assert below keeps it honest */
+#define MNEMONIC_SLOTS 0x100
+#define MNEMONIC_MUL 0x969215A5u
+
+static constexpr char fold(char c) { return c >= 'A' && c <= 'Z' ? c + 0x20 : c; }
+
+static constexpr u32 mnemonic_hash(const char *s, u32 len)
+{
+	return (u32) ((fold(s[0]) | fold(s[1]) << 8 | fold(s[2]) << 16 | len << 24) * MNEMONIC_MUL) >> 24;
+}
+
+static constexpr u32 name_length(const char *s)
+{
+	u32 n = 0;
+	while (s[n]) ++n;
+	return n;
+}
+
+struct mnemonic_table {
+	u8 slot[MNEMONIC_SLOTS];
+	bool perfect;
+
+	constexpr mnemonic_table() : slot(), perfect(true)
+	{
+		for (int i = 1; i < MNEMONIC_COUNT; ++i) {
+			u32 h = mnemonic_hash(mnemonic_names[i], name_length(mnemonic_names[i]));
+			if (slot[h]) perfect = false;
+			slot[h] = i;
+		}
+	}
+};
+
+static constexpr mnemonic_table mnemonics {};
+static_assert(mnemonics.perfect, "mnemonic hash has collisions, pick another MNEMONIC_MUL");
+
+/* Dense id of a mnemonic, M_NONE for any other token */
+static inline int mnemonic_of(const char *s, u32 len)
+{
+	const char *name;
+	u32 i;
+
+	if (len < 3 || len > 7)
+		return M_NONE;
+
+	int id = mnemonics.slot[mnemonic_hash(s, len)];
+	for (name = mnemonic_names[id], i = 0; i < len; ++i)
+		if (fold(s[i]) != fold(name[i])) return M_NONE;
+
+	return name[len] ? M_NONE : id;
+}
+
+/*
+ * mnemonic x addressing mode -> opcode, size and base cycles (a page
+ * crossing or a taken branch adds to those). A mode missing from the
+ * list simply isn't legal for that mnemonic.
+ */
+struct opcode {
+	u8 code {}, bytes {}, cycles {};
+};
+
+static constexpr u8 mode_bytes(u16 mode)
+{
+	return mode == IMPLIED || mode == ACCUMULATOR ? 1
+	     : mode == ABSOLUTE || mode == ABSOLUTE_X || mode == ABSOLUTE_Y || mode == INDIRECT ? 3
+	     : 2;
+}
+
+static constexpr struct {
+	int m;
+	u16 mode;
+	u8 code, cycles;
+} opcode_list[] = {
+#define OP(m, mode, code, cycles) { M_##m, mode, code, cycles },
+#define ALU(m, base)								\
+	OP(m, IMMEDIATE,  base + 0x08, 2)					\
+	OP(m, ZEROPAGE,   base + 0x04, 3)					\
+	OP(m, ZEROPAGE_X, base + 0x14, 4)					\
+	OP(m, ABSOLUTE,   base + 0x0C, 4)					\
+	OP(m, ABSOLUTE_X, base + 0x1C, 4)					\
+	OP(m, ABSOLUTE_Y, base + 0x18, 4)					\
+	OP(m, INDIRECT_X, base + 0x00, 6)					\
+	OP(m, INDIRECT_Y, base + 0x10, 5)
+#define SHIFT(m, base)								\
+	OP(m, ACCUMULATOR, base + 0x0A, 2)					\
+	OP(m, ZEROPAGE,    base + 0x06, 5)					\
+	OP(m, ZEROPAGE_X,  base + 0x16, 6)					\
+	OP(m, ABSOLUTE,    base + 0x0E, 6)					\
+	OP(m, ABSOLUTE_X,  base + 0x1E, 7)
+	ALU(ORA, 0x01) ALU(AND, 0x21) ALU(EOR, 0x41) ALU(ADC, 0x61)
+	ALU(LDA, 0xA1) ALU(CMP, 0xC1) ALU(SBC, 0xE1)
+	SHIFT(ASL, 0x00) SHIFT(ROL, 0x20) SHIFT(LSR, 0x40) SHIFT(ROR, 0x60)
+
+	OP(STA, ZEROPAGE, 0x85, 3) OP(STA, ZEROPAGE_X, 0x95, 4) OP(STA, ABSOLUTE, 0x8D, 4)
+	OP(STA, ABSOLUTE_X, 0x9D, 5) OP(STA, ABSOLUTE_Y, 0x99, 5)
+	OP(STA, INDIRECT_X, 0x81, 6) OP(STA, INDIRECT_Y, 0x91, 6)
+
+	OP(LDX, IMMEDIATE, 0xA2, 2) OP(LDX, ZEROPAGE, 0xA6, 3) OP(LDX, ZEROPAGE_Y, 0xB6, 4)
+	OP(LDX, ABSOLUTE, 0xAE, 4) OP(LDX, ABSOLUTE_Y, 0xBE, 4)
+	OP(LDY, IMMEDIATE, 0xA0, 2) OP(LDY, ZEROPAGE, 0xA4, 3) OP(LDY, ZEROPAGE_X, 0xB4, 4)
+	OP(LDY, ABSOLUTE, 0xAC, 4) OP(LDY, ABSOLUTE_X, 0xBC, 4)
+	OP(STX, ZEROPAGE, 0x86, 3) OP(STX, ZEROPAGE_Y, 0x96, 4) OP(STX, ABSOLUTE, 0x8E, 4)
+	OP(STY, ZEROPAGE, 0x84, 3) OP(STY, ZEROPAGE_X, 0x94, 4) OP(STY, ABSOLUTE, 0x8C, 4)
+
+	OP(CPX, IMMEDIATE, 0xE0, 2) OP(CPX, ZEROPAGE, 0xE4, 3) OP(CPX, ABSOLUTE, 0xEC, 4)
+	OP(CPY, IMMEDIATE, 0xC0, 2) OP(CPY, ZEROPAGE, 0xC4, 3) OP(CPY, ABSOLUTE, 0xCC, 4)
+	OP(BIT, ZEROPAGE, 0x24, 3) OP(BIT, ABSOLUTE, 0x2C, 4)
+
+	OP(INC, ZEROPAGE, 0xE6, 5) OP(INC, ZEROPAGE_X, 0xF6, 6) OP(INC, ABSOLUTE, 0xEE, 6) OP(INC, ABSOLUTE_X, 0xFE, 7)
+	OP(DEC, ZEROPAGE, 0xC6, 5) OP(DEC, ZEROPAGE_X, 0xD6, 6) OP(DEC, ABSOLUTE, 0xCE, 6) OP(DEC, ABSOLUTE_X, 0xDE, 7)
+
+	OP(BPL, RELATIVE, 0x10, 2) OP(BMI, RELATIVE, 0x30, 2) OP(BVC, RELATIVE, 0x50, 2) OP(BVS, RELATIVE, 0x70, 2)
+	OP(BCC, RELATIVE, 0x90, 2) OP(BCS, RELATIVE, 0xB0, 2) OP(BNE, RELATIVE, 0xD0, 2) OP(BEQ, RELATIVE, 0xF0, 2)
+
+	OP(JMP, ABSOLUTE, 0x4C, 3) OP(JMP, INDIRECT, 0x6C, 5)
+	OP(JSR, ABSOLUTE, 0x20, 6)
+
+	OP(INX, IMPLIED, 0xE8, 2) OP(INY, IMPLIED, 0xC8, 2) OP(DEX, IMPLIED, 0xCA, 2) OP(DEY, IMPLIED, 0x88, 2)
+	OP(TAX, IMPLIED, 0xAA, 2) OP(TXA, IMPLIED, 0x8A, 2) OP(TAY, IMPLIED, 0xA8, 2) OP(TYA, IMPLIED, 0x98, 2)
+	OP(TSX, IMPLIED, 0xBA, 2) OP(TXS, IMPLIED, 0x9A, 2)
+	OP(PHA, IMPLIED, 0x48, 3) OP(PHP, IMPLIED, 0x08, 3) OP(PLA, IMPLIED, 0x68, 4) OP(PLP, IMPLIED, 0x28, 4)
+	OP(CLC, IMPLIED, 0x18, 2) OP(CLD, IMPLIED, 0xD8, 2) OP(CLI, IMPLIED, 0x58, 2) OP(CLV, IMPLIED, 0xB8, 2)
+	OP(SEC, IMPLIED, 0x38, 2) OP(SED, IMPLIED, 0xF8, 2) OP(SEI, IMPLIED, 0x78, 2)
+	OP(RTI, IMPLIED, 0x40, 6) OP(RTS, IMPLIED, 0x60, 6)
+	OP(NOP, IMPLIED, 0xEA, 2) OP(BRK, IMPLIED, 0x00, 7)
+	OP(SYSCALL, IMPLIED, 0x00, 7) OP(BREAK, IMPLIED, 0x00, 7)
+
+#define RMW(m, base)								\
+	OP(m, INDIRECT_X, base + 0x00, 8)					\
+	OP(m, ZEROPAGE,   base + 0x04, 5)					\
+	OP(m, ABSOLUTE,   base + 0x0C, 6)					\
+	OP(m, INDIRECT_Y, base + 0x10, 8)					\
+	OP(m, ZEROPAGE_X, base + 0x14, 6)					\
+	OP(m, ABSOLUTE_Y, base + 0x18, 7)					\
+	OP(m, ABSOLUTE_X, base + 0x1C, 7)
+	RMW(SLO, 0x03) RMW(RLA, 0x23) RMW(SRE, 0x43) RMW(RRA, 0x63) RMW(DCP, 0xC3) RMW(ISC, 0xE3)
+	OP(LAX, ZEROPAGE, 0xA7, 3) OP(LAX, ZEROPAGE_Y, 0xB7, 4) OP(LAX, ABSOLUTE, 0xAF, 4)
+	OP(LAX, ABSOLUTE_Y, 0xBF, 4) OP(LAX, INDIRECT_X, 0xA3, 6) OP(LAX, INDIRECT_Y, 0xB3, 5)
+	OP(SAX, ZEROPAGE, 0x87, 3) OP(SAX, ZEROPAGE_Y, 0x97, 4) OP(SAX, ABSOLUTE, 0x8F, 4) OP(SAX, INDIRECT_X, 0x83, 6)
+	OP(ANC, IMMEDIATE, 0x0B, 2) OP(ALR, IMMEDIATE, 0x4B, 2) OP(ARR, IMMEDIATE, 0x6B, 2) OP(AXS, IMMEDIATE, 0xCB, 2)
+#undef RMW
+#undef SHIFT
+#undef ALU
+#undef OP
+};
+
+struct opcode_matrix {
+	opcode op[MNEMONIC_COUNT][MODE_COUNT];
+	bool known[MNEMONIC_COUNT];
+	bool unique;
+
+	constexpr opcode_matrix() : op(), known(), unique(true)
+	{
+		for (auto& e : opcode_list) {
+			opcode& o = op[e.m][MODE(e.mode)];
+			if (o.bytes) unique = false;
+			o.code = e.code;
+			o.bytes = mode_bytes(e.mode);
+			o.cycles = e.cycles;
+			known[e.m] = true;
+		}
+	}
+
+	/* bytes is 0 for a mode the mnemonic doesn't have */
+	constexpr const opcode& at(int m, u16 mode) const { return op[m][MODE(mode)]; }
+};
+
+static constexpr opcode_matrix opcodes {};
+static_assert(opcodes.unique, "an opcode is listed twice");
+static_assert(opcodes.at(M_LDA, INDIRECT_Y).code == 0xB1 && opcodes.at(M_ROR, ABSOLUTE_X).code == 0x7E, "opcode matrix is off");
+
+/*
+ * Status flags each mnemonic changes, for the optimizer, which registers
+ * N and Z mirror after it when it sets them from one, and which
+ * registers it writes. A branch
+ * opcode is flag << 6 | taken-when-set << 5 | 0x10 with the flags
+ * numbered N V C Z, so flipping 0x20 inverts it.
+ */
+#define F_C 0x01
+#define F_Z 0x02
+#define F_I 0x04
+#define F_D 0x08
+#define F_V 0x40
+#define F_N 0x80
+#define F_NZ (F_N | F_Z)
+#define F_ALL 0xFF
+
+#define R_A 0x01
+#define R_X 0x02
+#define R_Y 0x04
+
+static constexpr u8 branch_flags[] = { F_N, F_V, F_C, F_Z };
+
+static constexpr struct {
+	int m;
+	u8 flags, nz, regs;
+} flag_list[] = {
+	{ M_ADC, F_NZ | F_V | F_C, R_A, R_A }, { M_SBC, F_NZ | F_V | F_C, R_A, R_A }, { M_BIT, F_NZ | F_V },
+	{ M_AND, F_NZ, R_A, R_A }, { M_ORA, F_NZ, R_A, R_A }, { M_EOR, F_NZ, R_A, R_A },
+	{ M_ASL, F_NZ | F_C }, { M_LSR, F_NZ | F_C }, { M_ROL, F_NZ | F_C }, { M_ROR, F_NZ | F_C },
+	{ M_CMP, F_NZ | F_C }, { M_CPX, F_NZ | F_C }, { M_CPY, F_NZ | F_C },
+	{ M_INC, F_NZ }, { M_DEC, F_NZ }, { M_INX, F_NZ, R_X, R_X }, { M_INY, F_NZ, R_Y, R_Y }, { M_DEX, F_NZ, R_X, R_X }, { M_DEY, F_NZ, R_Y, R_Y },
+	{ M_LDA, F_NZ, R_A, R_A }, { M_LDX, F_NZ, R_X, R_X }, { M_LDY, F_NZ, R_Y, R_Y }, { M_PLA, F_NZ, R_A, R_A },
+	{ M_TAX, F_NZ, R_A | R_X, R_X }, { M_TAY, F_NZ, R_A | R_Y, R_Y }, { M_TSX, F_NZ, R_X, R_X },
+	{ M_TXA, F_NZ, R_A | R_X, R_A }, { M_TYA, F_NZ, R_A | R_Y, R_A },
+	{ M_CLC, F_C }, { M_SEC, F_C }, { M_CLD, F_D }, { M_SED, F_D }, { M_CLI, F_I }, { M_SEI, F_I }, { M_CLV, F_V },
+	/* whatever runs before control comes back */
+	{ M_PLP, F_ALL }, { M_RTI, F_ALL, 0, R_A | R_X | R_Y }, { M_JSR, F_ALL, 0, R_A | R_X | R_Y },
+	{ M_BRK, F_ALL, 0, R_A | R_X | R_Y }, { M_SYSCALL, F_ALL, 0, R_A | R_X | R_Y }, { M_BREAK, F_ALL, 0, R_A | R_X | R_Y },
+	/* undocumented */
+	{ M_SLO, F_NZ | F_C, R_A, R_A }, { M_RLA, F_NZ | F_C, R_A, R_A }, { M_SRE, F_NZ | F_C, R_A, R_A },
+	{ M_RRA, F_NZ | F_V | F_C, R_A, R_A }, { M_ISC, F_NZ | F_V | F_C, R_A, R_A }, { M_DCP, F_NZ | F_C },
+	{ M_LAX, F_NZ, R_A | R_X, R_A | R_X }, { M_ANC, F_NZ | F_C, R_A, R_A }, { M_ALR, F_NZ | F_C, R_A, R_A },
+	{ M_ARR, F_NZ | F_V | F_C, R_A, R_A }, { M_AXS, F_NZ | F_C, R_X, R_X },
+};
+
+/* -O with -undoc: a read-modify-write followed by an op on the same
+   operand is one undocumented instruction, ldx+txa and lda+tax are lax */
+static constexpr struct {
+	int first, second, fused;
+} fusion_list[] = {
+	{ M_ASL, M_ORA, M_SLO }, { M_ROL, M_AND, M_RLA }, { M_LSR, M_EOR, M_SRE },
+	{ M_ROR, M_ADC, M_RRA }, { M_DEC, M_CMP, M_DCP }, { M_INC, M_SBC, M_ISC },
+	{ M_LDA, M_TAX, M_LAX }, { M_LDX, M_TXA, M_LAX },
+};
+
+struct flag_table {
+	u8 writes[MNEMONIC_COUNT];
+	u8 nz[MNEMONIC_COUNT];	// shifts of A add R_A
+	u8 regs[MNEMONIC_COUNT];	// here too
+
+	constexpr flag_table() : writes(), nz(), regs()
+	{
+		for (auto& e : flag_list) {
+			writes[e.m] = e.flags;
+			nz[e.m] = e.nz;
+			regs[e.m] = e.regs;
+		}
+	}
+};
+
+static constexpr flag_table mnemonic_flags {};
+static_assert(opcodes.at(M_BEQ, RELATIVE).code == (3 << 6 | 1 << 5 | 0x10), "branch opcodes are off");
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+/*
+ * Vectorized scanners for the lexer's skip loops. Every scanner stops on
+ * the NUL sentinel, and may read up to 31 bytes past the byte it stops on,
+ * so buffers handed to them need at least 0x20 bytes of zero padding.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+/* ' ', '\t', '\v', '\f', '\r' but not '\n' */
+static inline bool is_blank(u8 c) { return c == ' ' || (c >= '\t' && c <= '\r' && c != '\n'); }
+
+static size_t scan_blanks_c(const char *p)
+{
+	const char *s = p;
+	while (is_blank(*p)) ++p;
+	return p - s;
+}
+
+static size_t scan_line_c(const char *p)
+{
+	const char *s = p;
+	while (*p && *p != '\n') ++p;
+	return p - s;
+}
+
+static size_t scan_blank_lines_c(const char *p)
+{
+	const char *s = p;
+	while (is_blank(*p) || *p == '\n') ++p;
+	return p - s;
+}
+
+#ifdef SCAN_X86
+#define SCAN_BLANK(v, V, S)							\
+	V##_or_si##S(V##_or_si##S(V##_cmpeq_epi8(v, V##_set1_epi8(' ')),	\
+				  V##_cmpeq_epi8(v, V##_set1_epi8('\t'))),	\
+		     V##_or_si##S(V##_cmpeq_epi8(v, V##_set1_epi8('\r')),	\
+				  V##_or_si##S(V##_cmpeq_epi8(v, V##_set1_epi8('\v')),	\
+					       V##_cmpeq_epi8(v, V##_set1_epi8('\f')))))
+
+__attribute__((target("sse2")))
+static size_t scan_blanks_sse2(const char *p)
+{
+	size_t n = 0;
+	u32 m;
+
+	for (;; n += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (p + n));
+		m = ~_mm_movemask_epi8(SCAN_BLANK(v, _mm, 128)) & 0xFFFF;
+		if (m) return n + __builtin_ctz(m);
+	}
+}
+
+__attribute__((target("sse2")))
+static size_t scan_line_sse2(const char *p)
+{
+	size_t n = 0;
+	u32 m;
+
+	for (;; n += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (p + n));
+		m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+						   _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+		if (m) return n + __builtin_ctz(m);
+	}
+}
+
+__attribute__((target("sse2")))
+static size_t scan_blank_lines_sse2(const char *p)
+{
+	size_t n = 0;
+	u32 m;
+
+	for (;; n += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (p + n));
+		__m128i l = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+		m = ~_mm_movemask_epi8(_mm_or_si128(SCAN_BLANK(v, _mm, 128), l)) & 0xFFFF;
+		if (m) return n + __builtin_ctz(m);
+	}
+}
+
+__attribute__((target("avx2")))
+static size_t scan_blanks_avx2(const char *p)
+{
+	size_t n = 0;
+	u32 m;
+
+	for (;; n += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (p + n));
+		m = ~(u32) _mm256_movemask_epi8(SCAN_BLANK(v, _mm256, 256));
+		if (m) return n + __builtin_ctz(m);
+	}
+}
+
+__attribute__((target("avx2")))
+static size_t scan_line_avx2(const char *p)
+{
+	size_t n = 0;
+	u32 m;
+
+	for (;; n += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (p + n));
+		m = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+							 _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+		if (m) return n + __builtin_ctz(m);
+	}
+}
+
+__attribute__((target("avx2")))
+static size_t scan_blank_lines_avx2(const char *p)
+{
+	size_t n = 0;
+	u32 m;
+
+	for (;; n += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (p + n));
+		__m256i l = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+		m = ~(u32) _mm256_movemask_epi8(_mm256_or_si256(SCAN_BLANK(v, _mm256, 256), l));
+		if (m) return n + __builtin_ctz(m);
+	}
+}
+#undef SCAN_BLANK
+#endif
+
+struct scanner {
+	size_t (*blanks)(const char *p);
+	size_t (*line)(const char *p);
+	size_t (*blank_lines)(const char *p);
+};
+
+/* Picked once at startup from what the cpu actually supports */
+static scanner pick_scanner()
+{
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return { scan_blanks_avx2, scan_line_avx2, scan_blank_lines_avx2 };
+	if (__builtin_cpu_supports("sse2"))
+		return { scan_blanks_sse2, scan_line_sse2, scan_blank_lines_sse2 };
+#endif
+	return { scan_blanks_c, scan_line_c, scan_blank_lines_c };
+}
+
+static const scanner scan = pick_scanner();
+
+#endif
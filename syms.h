@@ -1,31 +1,218 @@
 #ifndef SYMS_H
 #define SYMS_H
 
+/* A token is a span of the source buffer it was read from, numbers
+   carry their value and width class decoded once by the lexer */
 struct Sym {
-	std::string token {};
+	u32 offset {};
+	u32 length {};
 	int id {};
+	u16 width {}; // zpg abs imm?
+	u32 value {};
 };
 
+/* A whole file worth of tokens, one array per field so the parser walks
+   each of them linearly. lines holds the first token of every non empty
+   line and ends with the total token count. A DATA_LIST token stands for
+   a whole db/dw list already decoded by the lexer, its value n means the
+   bytes data[list_bounds[n]] up to data[list_bounds[n + 1]]. */
+struct TokenBuffer {
+	u16 *kinds {};
+	u32 *values {};
+	u32 *offsets {};
+	u32 *lengths {};
+	u32 count {}, capacity {};
+	arena *mem;
+	arena_vector<u32> lines;
+	arena_vector<u8> data;
+	arena_vector<u32> list_bounds;
+
+	TokenBuffer(arena *a) : mem(a), lines(a), data(a), list_bounds(1, 0, a) {}
+	TokenBuffer(const TokenBuffer&) = delete;
+
+	/* Lives in the assembly's arena like everything it points to */
+	void reserve(u32 n)
+	{
+		if (n <= capacity) return;
+		kinds = (u16 *) mem->resize(kinds, capacity * sizeof *kinds, n * sizeof *kinds);
+		values = (u32 *) mem->resize(values, capacity * sizeof *values, n * sizeof *values);
+		offsets = (u32 *) mem->resize(offsets, capacity * sizeof *offsets, n * sizeof *offsets);
+		lengths = (u32 *) mem->resize(lengths, capacity * sizeof *lengths, n * sizeof *lengths);
+		capacity = n;
+	}
+
+	inline void push(const Sym& s)
+	{
+		if (count == capacity) reserve(capacity * 2 + 0x100);
+		kinds[count] = s.id;
+		values[count] = s.value;
+		offsets[count] = s.offset;
+		lengths[count] = s.length;
+		count++;
+	}
+
+	Sym at(u32 i) const
+	{
+		Sym s;
+		s.offset = offsets[i];
+		s.length = lengths[i];
+		s.id = kinds[i];
+		s.value = values[i];
+		if (s.id == DIGIT) s.width = s.value <= 0xFF ? ZEROPAGE : ABSOLUTE;
+		else if (s.id == ZEROPAGE || s.id == ABSOLUTE || s.id == IMMEDIATE) s.width = s.id;
+		else s.width = _NONE;
+		return s;
+	}
+
+	void clear()
+	{
+		count = 0;
+		lines.clear();
+		data.clear();
+		list_bounds.assign(1, 0);
+	}
+};
+
+/* Every distinct identifier is stored once, NUL terminated, and named
+   by a 32 bit id everywhere else. id 0 is the empty name. The index is
+   open addressing over the ids, kept at most half full. */
+class intern_pool {
+private:
+	arena_vector<char> chars;
+	arena_vector<u32> starts;
+	arena_vector<u32> hashes;
+	arena_vector<u32> slots;
+
+	static u32 hash(const char *s, u32 len)
+	{
+		u32 h = 0x811C9DC5;
+		while (len--) h = (h ^ (u8) *s++) * 0x01000193;
+		return h;
+	}
+
+	bool same(u32 id, u32 h, const char *s, u32 len) const
+	{
+		return hashes[id] == h && length(id) == len && !memcmp(&chars[starts[id]], s, len);
+	}
+
+	void grow()
+	{
+		arena_vector<u32> old(slots.size() ? slots.size() * 2 : 0x400, 0, slots.get_allocator());
+		u32 mask = old.size() - 1, k;
+
+		slots.swap(old);
+		for (u32 id : old) {
+			if (!id) continue;
+			for (k = hashes[id] & mask; slots[k]; k = (k + 1) & mask);
+			slots[k] = id;
+		}
+	}
+
+public:
+	intern_pool(arena *a) : chars(1, '\0', a), starts(1, 0, a), hashes(1, 0, a), slots(a) {}
+
+	/* 0 if the name was never interned */
+	u32 find(const char *s, u32 len) const
+	{
+		u32 h = hash(s, len), mask = slots.size() - 1, k;
+
+		if (!len || slots.empty()) return 0;
+		for (k = h & mask; slots[k]; k = (k + 1) & mask)
+			if (same(slots[k], h, s, len)) return slots[k];
+		return 0;
+	}
+
+	u32 intern(const char *s, u32 len)
+	{
+		u32 h = hash(s, len), id, k, mask;
+
+		if (!len) return 0;
+		if ((starts.size() + 1) * 2 > slots.size()) grow();
+		mask = slots.size() - 1;
+		for (k = h & mask; slots[k]; k = (k + 1) & mask)
+			if (same(slots[k], h, s, len)) return slots[k];
+
+		id = starts.size();
+		starts.push_back(chars.size());
+		hashes.push_back(h);
+		chars.insert(chars.end(), s, s + len);
+		chars.push_back('\0');
+		return slots[k] = id;
+	}
+
+	/* Only good until the next intern */
+	inline const char *name(u32 id) const { return &chars[starts[id]]; }
+	inline u32 length(u32 id) const { return (id + 1 < starts.size() ? starts[id + 1] : chars.size()) - starts[id] - 1; }
+	inline u32 count() const { return starts.size() - 1; }
+	inline size_t bytes() const { return chars.capacity() + (starts.capacity() + hashes.capacity() + slots.capacity()) * sizeof(u32); }
+
+	void clear()
+	{
+		chars.assign(1, '\0');
+		starts.assign(1, 0);
+		hashes.assign(1, 0);
+		slots.clear();
+	}
+};
+
+/* An equate, NAME = expr. One naming a label that isn't defined yet
+   keeps its expression and is resolved wherever it's used. */
 struct Variable {
-	std::string name {};
-	u16 value;
-	u8 type; // zpg abs imm?
+	u32 name {};
+	s32 value;
+	u8 type; // MODE() of its width, zpg or abs
+	bool known {true}, label {};
+	u32 node {};	// the expression, when not known
 };
 
 struct Label {
-	std::string label {};
+	u32 label {};
 	location_t addr;
 	u8 section; // data or text?
 };
 
-struct Instruction {
-public:
-	u8 opcode {};
-	u8 bytes {};
-	u16 value {};
-	Label label;
-	u8 required_jump {}; // 0x1 = JUMP 0x2 = RELATIVE
-	inline void reverse() { value = (value >> 8) | (value & 0xFF) << 8; }
+/* Operand expressions, kept as nodes only for the parts naming a label
+   that isn't defined yet. Unary operators come before the binary ones,
+   which are in the order of expr_precedence. */
+enum {
+	X_CONST, X_SYMBOL,
+	X_NEG, X_NOT, X_LO, X_HI,
+	X_MUL, X_DIV, X_ADD, X_SUB, X_SHL, X_SHR, X_AND, X_XOR, X_OR,
+};
+
+struct Expr {
+	s32 value;	// X_CONST value, X_SYMBOL symbol id
+	u32 lhs, rhs;
+	u8 op;
+};
+
+#define FIXUP_WORD 0x1
+#define FIXUP_RELATIVE 0x2
+#define FIXUP_BYTE 0x3
+
+/* An operand to patch into its section's bin at link time */
+struct Fixup {
+	u32 at;		// offset of the operand in the bin
+	u32 expr;	// root node in exprs
+	u16 addr;	// of the instruction or data, for diagnostics
+	u8 kind;	// FIXUP_*
+	u8 section;
+};
+
+/* A jmp some pass put at addr, so -O can send jumps to it on to target */
+struct Jump {
+	u16 addr, target;
+};
+
+/* What -O knows at a point of the program. The flags in flags_known
+   hold the values in flags, the registers in regs_known (R_A, R_X,
+   R_Y) hold reg[], and N and Z mirror the registers in nz. reached is
+   clear until something flows in. */
+struct flow_state {
+	u8 flags_known, flags;
+	u8 regs_known, reg[3];
+	u8 nz;
+	bool reached;
 };
 
 #endif
@@ -0,0 +1,131 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+/*
+ * What the tests share: a body is assembled at $C000 right after _main,
+ * and the text it comes out as is compared byte for byte up to the end
+ * label put after it, or .data against the start of CHR-ROM.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "nesasm.h"
+
+#define ORG 0xC000
+#define HEADER 0x10
+#define CHR (HEADER + 0x4000)
+
+enum { OPT = 1, UNDOC = 2 };
+
+static int checked, failed;
+
+/* "A9 05 00" into its bytes */
+static inline std::vector<uint8_t> hex(const char *s)
+{
+	std::vector<uint8_t> b;
+	char *e;
+
+	for (;;) {
+		unsigned long v = strtoul(s, &e, 16);
+		if (e == s) break;
+		b.push_back((uint8_t) v);
+		s = e;
+	}
+	return b;
+}
+
+static inline std::string nops(int n)
+{
+	std::string s;
+
+	while (n--) s += "\tnop\n";
+	return s;
+}
+
+static inline nesasm_result assemble(const char *name, int flags, const std::string& body)
+{
+	nesasm_options opt;
+
+	opt.name = name;
+	opt.optimize = flags & OPT;
+	opt.undocumented = flags & UNDOC;
+	return nesasm_assemble(".org $C000\n.text\n_main:\n" + body + "\n.text\nend:\n", opt);
+}
+
+static inline void dump(const char *what, const uint8_t *b, size_t n)
+{
+	fprintf(stderr, "  %s", what);
+	for (size_t i = 0; i < n; ++i) fprintf(stderr, " %02X", b[i]);
+	fprintf(stderr, "\n");
+}
+
+static inline void fail(const char *name, int flags, const nesasm_result& r, const char *why)
+{
+	fprintf(stderr, "%s%s%s: %s\n%s", name, flags & OPT ? " -O" : "", flags & UNDOC ? " -undoc" : "", why, r.diagnostics.c_str());
+	failed++;
+}
+
+/* The text from _main to end has to be exactly expect */
+static inline void check(const char *name, int flags, const std::string& body, const std::vector<uint8_t>& expect)
+{
+	nesasm_result r = assemble(name, flags, body);
+	size_t n = (size_t) -1;
+
+	checked++;
+	for (const auto& s : r.symbols)
+		if (s.name == "end") n = s.value - ORG;
+	if (r.status || n == (size_t) -1) {
+		fail(name, flags, r, "didn't assemble");
+		return;
+	}
+	if (n != expect.size() || HEADER + n > r.rom.size() || memcmp(&r.rom[HEADER], expect.data(), n)) {
+		fail(name, flags, r, "wrong bytes");
+		dump("expected", expect.data(), expect.size());
+		dump("got     ", &r.rom[HEADER], HEADER + n <= r.rom.size() ? n : 0);
+	}
+}
+
+static inline void check(const char *name, int flags, const std::string& body, const char *expect)
+{
+	check(name, flags, body, hex(expect));
+}
+
+/* .data from the start of CHR-ROM */
+static inline void check_data(const char *name, const std::string& body, const char *expect)
+{
+	nesasm_result r = assemble(name, 0, "\tbrk\n.data\n" + body);
+	std::vector<uint8_t> b = hex(expect);
+
+	checked++;
+	if (r.status) {
+		fail(name, 0, r, "didn't assemble");
+		return;
+	}
+	if (CHR + b.size() > r.rom.size() || memcmp(&r.rom[CHR], b.data(), b.size())) {
+		fail(name, 0, r, "wrong bytes");
+		dump("expected", b.data(), b.size());
+		dump("got     ", CHR + b.size() <= r.rom.size() ? &r.rom[CHR] : NULL, CHR + b.size() <= r.rom.size() ? b.size() : 0);
+	}
+}
+
+/* Has to fail, saying error somewhere in its diagnostics */
+static inline void check_error(const char *name, int flags, const std::string& body, const char *error)
+{
+	nesasm_result r = assemble(name, flags, body);
+
+	checked++;
+	if (!r.status)
+		fail(name, flags, r, "assembled but shouldn't have");
+	else if (r.diagnostics.find(error) == std::string::npos)
+		fail(name, flags, r, "failed for another reason");
+}
+
+static inline int report(const char *test)
+{
+	printf("%s: %d cases, %d failed\n", test, checked, failed);
+	return !!failed;
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * Encodings: every official opcode in each of its addressing modes, the
+ * undocumented ones behind -undoc, where the zero page ends, expressions
+ * and db/dw lists.
+ */
+#include "check.h"
+
+static const struct {
+	const char *line, *bytes;
+} official[] = {
+	{ "\tadc #$10", "69 10" },
+	{ "\tadc $10", "65 10" },
+	{ "\tadc $10,x", "75 10" },
+	{ "\tadc $1234", "6D 34 12" },
+	{ "\tadc $1234,x", "7D 34 12" },
+	{ "\tadc $1234,y", "79 34 12" },
+	{ "\tadc ($10,x)", "61 10" },
+	{ "\tadc ($10),y", "71 10" },
+	{ "\tand #$10", "29 10" },
+	{ "\tand $10", "25 10" },
+	{ "\tand $10,x", "35 10" },
+	{ "\tand $1234", "2D 34 12" },
+	{ "\tand $1234,x", "3D 34 12" },
+	{ "\tand $1234,y", "39 34 12" },
+	{ "\tand ($10,x)", "21 10" },
+	{ "\tand ($10),y", "31 10" },
+	{ "\tasl a", "0A" },
+	{ "\tasl $10", "06 10" },
+	{ "\tasl $10,x", "16 10" },
+	{ "\tasl $1234", "0E 34 12" },
+	{ "\tasl $1234,x", "1E 34 12" },
+	{ "\tbit $10", "24 10" },
+	{ "\tbit $1234", "2C 34 12" },
+	{ "\tcmp #$10", "C9 10" },
+	{ "\tcmp $10", "C5 10" },
+	{ "\tcmp $10,x", "D5 10" },
+	{ "\tcmp $1234", "CD 34 12" },
+	{ "\tcmp $1234,x", "DD 34 12" },
+	{ "\tcmp $1234,y", "D9 34 12" },
+	{ "\tcmp ($10,x)", "C1 10" },
+	{ "\tcmp ($10),y", "D1 10" },
+	{ "\tcpx #$10", "E0 10" },
+	{ "\tcpx $10", "E4 10" },
+	{ "\tcpx $1234", "EC 34 12" },
+	{ "\tcpy #$10", "C0 10" },
+	{ "\tcpy $10", "C4 10" },
+	{ "\tcpy $1234", "CC 34 12" },
+	{ "\tdec $10", "C6 10" },
+	{ "\tdec $10,x", "D6 10" },
+	{ "\tdec $1234", "CE 34 12" },
+	{ "\tdec $1234,x", "DE 34 12" },
+	{ "\teor #$10", "49 10" },
+	{ "\teor $10", "45 10" },
+	{ "\teor $10,x", "55 10" },
+	{ "\teor $1234", "4D 34 12" },
+	{ "\teor $1234,x", "5D 34 12" },
+	{ "\teor $1234,y", "59 34 12" },
+	{ "\teor ($10,x)", "41 10" },
+	{ "\teor ($10),y", "51 10" },
+	{ "\tinc $10", "E6 10" },
+	{ "\tinc $10,x", "F6 10" },
+	{ "\tinc $1234", "EE 34 12" },
+	{ "\tinc $1234,x", "FE 34 12" },
+	{ "\tjmp $1234", "4C 34 12" },
+	{ "\tjmp ($1234)", "6C 34 12" },
+	{ "\tjsr $1234", "20 34 12" },
+	{ "\tlda #$10", "A9 10" },
+	{ "\tlda $10", "A5 10" },
+	{ "\tlda $10,x", "B5 10" },
+	{ "\tlda $1234", "AD 34 12" },
+	{ "\tlda $1234,x", "BD 34 12" },
+	{ "\tlda $1234,y", "B9 34 12" },
+	{ "\tlda ($10,x)", "A1 10" },
+	{ "\tlda ($10),y", "B1 10" },
+	{ "\tldx #$10", "A2 10" },
+	{ "\tldx $10", "A6 10" },
+	{ "\tldx $10,y", "B6 10" },
+	{ "\tldx $1234", "AE 34 12" },
+	{ "\tldx $1234,y", "BE 34 12" },
+	{ "\tldy #$10", "A0 10" },
+	{ "\tldy $10", "A4 10" },
+	{ "\tldy $10,x", "B4 10" },
+	{ "\tldy $1234", "AC 34 12" },
+	{ "\tldy $1234,x", "BC 34 12" },
+	{ "\tlsr a", "4A" },
+	{ "\tlsr $10", "46 10" },
+	{ "\tlsr $10,x", "56 10" },
+	{ "\tlsr $1234", "4E 34 12" },
+	{ "\tlsr $1234,x", "5E 34 12" },
+	{ "\tora #$10", "09 10" },
+	{ "\tora $10", "05 10" },
+	{ "\tora $10,x", "15 10" },
+	{ "\tora $1234", "0D 34 12" },
+	{ "\tora $1234,x", "1D 34 12" },
+	{ "\tora $1234,y", "19 34 12" },
+	{ "\tora ($10,x)", "01 10" },
+	{ "\tora ($10),y", "11 10" },
+	{ "\trol a", "2A" },
+	{ "\trol $10", "26 10" },
+	{ "\trol $10,x", "36 10" },
+	{ "\trol $1234", "2E 34 12" },
+	{ "\trol $1234,x", "3E 34 12" },
+	{ "\tror a", "6A" },
+	{ "\tror $10", "66 10" },
+	{ "\tror $10,x", "76 10" },
+	{ "\tror $1234", "6E 34 12" },
+	{ "\tror $1234,x", "7E 34 12" },
+	{ "\tsbc #$10", "E9 10" },
+	{ "\tsbc $10", "E5 10" },
+	{ "\tsbc $10,x", "F5 10" },
+	{ "\tsbc $1234", "ED 34 12" },
+	{ "\tsbc $1234,x", "FD 34 12" },
+	{ "\tsbc $1234,y", "F9 34 12" },
+	{ "\tsbc ($10,x)", "E1 10" },
+	{ "\tsbc ($10),y", "F1 10" },
+	{ "\tsta $10", "85 10" },
+	{ "\tsta $10,x", "95 10" },
+	{ "\tsta $1234", "8D 34 12" },
+	{ "\tsta $1234,x", "9D 34 12" },
+	{ "\tsta $1234,y", "99 34 12" },
+	{ "\tsta ($10,x)", "81 10" },
+	{ "\tsta ($10),y", "91 10" },
+	{ "\tstx $10", "86 10" },
+	{ "\tstx $10,y", "96 10" },
+	{ "\tstx $1234", "8E 34 12" },
+	{ "\tsty $10", "84 10" },
+	{ "\tsty $10,x", "94 10" },
+	{ "\tsty $1234", "8C 34 12" },
+	{ "\tbcc *+2", "90 00" },
+	{ "\tbcs *+2", "B0 00" },
+	{ "\tbeq *+2", "F0 00" },
+	{ "\tbmi *+2", "30 00" },
+	{ "\tbne *+2", "D0 00" },
+	{ "\tbpl *+2", "10 00" },
+	{ "\tbvc *+2", "50 00" },
+	{ "\tbvs *+2", "70 00" },
+	{ "\tbrk", "00" },
+	{ "\tclc", "18" },
+	{ "\tcld", "D8" },
+	{ "\tcli", "58" },
+	{ "\tclv", "B8" },
+	{ "\tdex", "CA" },
+	{ "\tdey", "88" },
+	{ "\tinx", "E8" },
+	{ "\tiny", "C8" },
+	{ "\tnop", "EA" },
+	{ "\tpha", "48" },
+	{ "\tphp", "08" },
+	{ "\tpla", "68" },
+	{ "\tplp", "28" },
+	{ "\trti", "40" },
+	{ "\trts", "60" },
+	{ "\tsec", "38" },
+	{ "\tsed", "F8" },
+	{ "\tsei", "78" },
+	{ "\ttax", "AA" },
+	{ "\ttay", "A8" },
+	{ "\ttsx", "BA" },
+	{ "\ttxa", "8A" },
+	{ "\ttxs", "9A" },
+	{ "\ttya", "98" },
+}, undocumented[] = {
+	{ "\tslo $10", "07 10" },
+	{ "\tslo $10,x", "17 10" },
+	{ "\tslo $1234", "0F 34 12" },
+	{ "\tslo $1234,x", "1F 34 12" },
+	{ "\tslo $1234,y", "1B 34 12" },
+	{ "\tslo ($10,x)", "03 10" },
+	{ "\tslo ($10),y", "13 10" },
+	{ "\trla $10", "27 10" },
+	{ "\trla $10,x", "37 10" },
+	{ "\trla $1234", "2F 34 12" },
+	{ "\trla $1234,x", "3F 34 12" },
+	{ "\trla $1234,y", "3B 34 12" },
+	{ "\trla ($10,x)", "23 10" },
+	{ "\trla ($10),y", "33 10" },
+	{ "\tsre $10", "47 10" },
+	{ "\tsre $10,x", "57 10" },
+	{ "\tsre $1234", "4F 34 12" },
+	{ "\tsre $1234,x", "5F 34 12" },
+	{ "\tsre $1234,y", "5B 34 12" },
+	{ "\tsre ($10,x)", "43 10" },
+	{ "\tsre ($10),y", "53 10" },
+	{ "\trra $10", "67 10" },
+	{ "\trra $10,x", "77 10" },
+	{ "\trra $1234", "6F 34 12" },
+	{ "\trra $1234,x", "7F 34 12" },
+	{ "\trra $1234,y", "7B 34 12" },
+	{ "\trra ($10,x)", "63 10" },
+	{ "\trra ($10),y", "73 10" },
+	{ "\tdcp $10", "C7 10" },
+	{ "\tdcp $10,x", "D7 10" },
+	{ "\tdcp $1234", "CF 34 12" },
+	{ "\tdcp $1234,x", "DF 34 12" },
+	{ "\tdcp $1234,y", "DB 34 12" },
+	{ "\tdcp ($10,x)", "C3 10" },
+	{ "\tdcp ($10),y", "D3 10" },
+	{ "\tisc $10", "E7 10" },
+	{ "\tisc $10,x", "F7 10" },
+	{ "\tisc $1234", "EF 34 12" },
+	{ "\tisc $1234,x", "FF 34 12" },
+	{ "\tisc $1234,y", "FB 34 12" },
+	{ "\tisc ($10,x)", "E3 10" },
+	{ "\tisc ($10),y", "F3 10" },
+	{ "\tlax $10", "A7 10" },
+	{ "\tlax $10,y", "B7 10" },
+	{ "\tlax $1234", "AF 34 12" },
+	{ "\tlax $1234,y", "BF 34 12" },
+	{ "\tlax ($10,x)", "A3 10" },
+	{ "\tlax ($10),y", "B3 10" },
+	{ "\tsax $10", "87 10" },
+	{ "\tsax $10,y", "97 10" },
+	{ "\tsax $1234", "8F 34 12" },
+	{ "\tsax ($10,x)", "83 10" },
+	{ "\tanc #$10", "0B 10" },
+	{ "\talr #$10", "4B 10" },
+	{ "\tarr #$10", "6B 10" },
+	{ "\taxs #$10", "CB 10" },
+};
+
+int main()
+{
+	std::string pad = "pad: db 0";
+
+	for (const auto& e : official)
+		check(e.line, 0, e.line, e.bytes);
+	for (const auto& e : undocumented) {
+		check(e.line, UNDOC, e.line, e.bytes);
+		check_error(e.line, 0, e.line, "undocumented, -undoc");
+	}
+	check("asl without a", 0, "\tasl", "0A");
+
+	/* the zero page by value, literal or label, down to where it ends */
+	check("literal $FF", 0, "\tlda $FF", "A5 FF");
+	check("literal $100", 0, "\tlda $100\n\tlda $0100", "AD 00 01 AD 00 01");
+	check("label in the zero page", 0, "\tlda v\n\tlda w,x\n\tlda v,y\n.rodata\nv: db 0\nw: db 0", "A5 00 B5 02 B9 00 00");
+	check("label above it", OPT, "\tlda v\n\tlda w,x\n.rodata\nv: db 0\nw: db 0", "A5 00 B5 02");
+	for (int k = 1; k < 253; ++k) pad += ",0";
+	check("labels at $FE and $100", 0, "\tlda a\n\tlda b\n\tsta b,x\n\tldx a,y\n.rodata\n" + pad + "\na: db 0\nb: db 0",
+	      "A5 FE AD 00 01 9D 00 01 B6 FE");
+	check("labels at $FE and $100 defined above", 0, ".rodata\n" + pad + "\na: db 0\nb: db 0\n.text\n\tlda a\n\tlda b",
+	      "A5 FE AD 00 01");
+	check_error("zero page operand past $FF", 0, "\tlda ($100),y", "zero page operand $100 out of range");
+
+	/* precedence, associativity and the unary operators */
+	check("* over +", 0, "\tlda #2+3*4", "A9 0E");
+	check("parentheses", 0, "\tlda #(2+3)*4", "A9 14");
+	check("<< over |", 0, "\tlda #1<<4|1", "A9 11");
+	check("& over ^", 0, "\tlda #$F0&$3C^$0F", "A9 3F");
+	check("- to the left", 0, "\tlda #10-4-3", "A9 03");
+	check("division", 0, "\tlda #100/7", "A9 0E");
+	check("< and >", 0, "\tlda #<$1234\n\tldx #>$1234", "A9 34 A2 12");
+	check("~ and -", 0, "\tlda #~0&$FF\n\tldx #-1", "A9 FF A2 FF");
+	check("* is here", 0, "\tnop\n\tjmp *", "EA 4C 01 C0");
+	check("label arithmetic", 0, "\tlda table+1,x\n\tldx #>table\n\tldy #<table\ntable:\n\tnop",
+	      "BD 08 C0 A2 C0 A0 07 EA");
+	check("equate of a later label", 0, "PTR = table+2\n\tlda PTR\n\tldx #<PTR\ntable:\n\tnop",
+	      "AD 07 C0 A2 07 EA");
+	check("equate of an equate", 0, "A = B+1\nB = 4\n\tlda #A", "A9 05");
+	check_error("equate of itself", 0, "A = B+1\nB = A\n\tlda A", "B is defined in terms of itself");
+	check_error("division by zero", 0, "\tlda #1/0", "division by zero");
+
+	/* db/dw, the lexer's fast path and the expressions alike */
+	check_data("literals", "db $FF, 255, %11111111, $0A\ndw $1234, 65535\ndb -128, <$1234", "FF FF FF 0A 34 12 FF FF 80 34");
+	check_data("expressions", "db 2*3, >table\ndw table+1\ntable = $ABCD", "06 AB CE AB");
+	check_error("db $1FF", 0, "\tbrk\n.data\ndb $1FF", "value $1FF doesn't fit a byte");
+	check_error("db 300", 0, "\tbrk\n.data\ndb 300", "value $12C doesn't fit a byte");
+	check_error("dw 65536", 0, "\tbrk\n.data\ndw 65536", "value $10000 doesn't fit a word");
+	check_error("db of a wide equate above", 0, "big = $1FF\n\tbrk\n.data\ndb big", "value $1FF doesn't fit a byte");
+	check_error("db of a wide equate below", 0, "\tbrk\n.data\ndb big\nbig = $1FF", "value $1FF doesn't fit a byte");
+
+	return report("encode");
+}
@@ -0,0 +1,117 @@
+/*
+ * What -O and -undoc rewrite, each rule next to a twin it mustn't fire
+ * on, and how far a branch reaches before it has to become a jmp.
+ */
+#include "check.h"
+
+static const struct {
+	const char *name;
+	int flags;
+	const char *body, *bytes;
+} cases[] = {
+	/* jsr then rts is a jmp, a label on the rts keeps it */
+	{ "jsr+rts", OPT, "\tjsr sub\n\trts\nsub:\n\tnop\n\trts", "4C 03 C0 EA 60" },
+	{ "jsr+rts, labeled rts", OPT, "\tjsr sub\nback:\n\trts\nsub:\n\tnop\n\trts", "4C 04 C0 60 EA 60" },
+	{ "jsr+rts without -O", 0, "\tjsr sub\n\trts\nsub:\n\tnop\n\trts", "20 04 C0 60 EA 60" },
+
+	/* the same immediate load again */
+	{ "reload", OPT, "\tlda #$05\n\tlda #$05\n\tsta $10", "A9 05 85 10" },
+	{ "reload, reached with another value", OPT, "\tlda #$05\nL:\n\tlda #$05\n\tsta $10\n\tlda #$06\n\tbne L",
+	  "A9 05 A9 05 85 10 A9 06 D0 F8" },
+
+	/* a zero page load of what was just stored while N and Z follow it */
+	{ "store+load", OPT, "\tlda $10\n\tsta $11\n\tlda $11", "A5 10 85 11" },
+	{ "store+load, flags from cmp", OPT, "\tlda $10\n\tcmp #$01\n\tsta $11\n\tlda $11", "A5 10 C9 01 85 11 A5 11" },
+	{ "store+load, absolute", OPT, "\tlda $10\n\tsta $0211\n\tlda $0211", "A5 10 8D 11 02 AD 11 02" },
+
+	/* a flag instruction whose flag is already so */
+	{ "known flag", OPT, "\tsec\n\tlda #$01\n\tsec\n\tcld\n\tcld", "38 A9 01 D8" },
+	{ "known flag, adc sets it", OPT, "\tsec\n\tadc #$01\n\tsec", "38 69 01 38" },
+
+	/* a load or transfer of what the register already holds */
+	{ "known value", OPT, "\tldx #$05\n\tstx $10\n\tldx #$05", "A2 05 86 10" },
+	{ "known value, transfer", OPT, "\tlda #$03\n\ttax\n\ttxa", "A9 03 AA" },
+	{ "known value, inx", OPT, "\tldx #$05\n\tinx\n\tldx #$05", "A2 05 E8 A2 05" },
+	{ "known value, after a jmp through a vector", OPT,
+	  "\tldx #$05\n\tjmp L\nother:\n\tldx #$07\n\tjmp ($0010)\nL:\n\tldx #$05\n\tstx $20\n\trts",
+	  "A2 05 10 05 A2 07 6C 10 00 A2 05 86 20 60" },
+	{ "known value, carried to a label", OPT, "\tldy #$00\n\tsty $10\n\tbcc L\n\tnop\nL:\n\tldy #$00",
+	  "A0 00 84 10 90 01 EA" },
+	{ "known value, label also used as data", OPT, "\tldy #$00\n\tsty $10\n\tbcc L\n\tnop\nL:\n\tldy #$00\n\tlda #<L",
+	  "A0 00 84 10 90 01 EA A0 00 A9 07" },
+
+	/* a jmp the flags decide is a branch, unless that crosses a page */
+	{ "jmp to branch", OPT, "\tclc\n\tjmp L\n\tnop\nL:\n\tnop", "18 90 01 EA EA" },
+	{ "jmp to branch, flags unknown", OPT, "\tadc #$01\n\tjmp L\n\tnop\nL:\n\tnop", "69 01 4C 06 C0 EA EA" },
+
+	/* a jmp to a jmp goes where that one does */
+	{ "jump threading", OPT, "\tjmp A\n\tnop\nA:\n\tjmp B\n\tnop\nB:\n\tnop", "4C 08 C0 EA 4C 08 C0 EA EA" },
+	{ "jump threading, not a jmp", OPT, "\tjmp A\n\tnop\nA:\n\tnop\n\tjmp B\n\tnop\nB:\n\tnop",
+	  "4C 04 C0 EA EA 4C 09 C0 EA EA" },
+
+	/* -undoc: a read-modify-write and an op on the same ram is one */
+	{ "fuse slo", OPT | UNDOC, "\tasl $10\n\tora $10", "07 10" },
+	{ "fuse rla", OPT | UNDOC, "\trol $10\n\tand $10", "27 10" },
+	{ "fuse sre", OPT | UNDOC, "\tlsr $10\n\teor $10", "47 10" },
+	{ "fuse rra", OPT | UNDOC, "\tror $10\n\tadc $10", "67 10" },
+	{ "fuse dcp", OPT | UNDOC, "\tdec $10\n\tcmp $10", "C7 10" },
+	{ "fuse isc", OPT | UNDOC, "\tinc $10,x\n\tsbc $10,x", "F7 10" },
+	{ "fuse absolute", OPT | UNDOC, "\tasl $0300\n\tora $0300", "0F 00 03" },
+	{ "fuse absolute,x", OPT | UNDOC, "\tdec $07F0,x\n\tcmp $07F0,x", "DF F0 07" },
+	{ "fuse lax", OPT | UNDOC, "\tlda $10\n\ttax\n\tlda ($10),y\n\ttax\n\tldx $1234,y\n\ttxa", "A7 10 B3 10 BF 34 12" },
+	{ "fuse, a register at $2002", OPT | UNDOC, "\tdec $2002\n\tcmp $2002", "CE 02 20 CD 02 20" },
+	{ "fuse, abs,x reaching $2000", OPT | UNDOC, "\tdec $1F80,x\n\tcmp $1F80,x", "DE 80 1F DD 80 1F" },
+	{ "fuse, another operand", OPT | UNDOC, "\tlsr $11\n\teor $12", "46 11 45 12" },
+	{ "fuse, label in between", OPT | UNDOC, "\tdec $10\nL:\n\tcmp $10", "C6 10 C5 10" },
+	{ "fuse without -undoc", OPT, "\tdec $10\n\tcmp $10", "C6 10 C5 10" },
+	{ "fuse, no lax zp,x", OPT | UNDOC, "\tlda $10,x\n\ttax", "B5 10 AA" },
+	{ "fuse, no lax #", OPT | UNDOC, "\tlda #$10\n\ttax", "A9 10 AA" },
+	{ "fuse, no lax # but known value", OPT | UNDOC, "\tldx #$10\n\tlda #$10\n\ttax", "A2 10 A9 10" },
+};
+
+int main()
+{
+	std::vector<uint8_t> b;
+
+	for (const auto& c : cases)
+		check(c.name, c.flags, c.body, c.bytes);
+
+	for (int flags = 0; flags <= OPT; flags += OPT) {
+		/* 127 bytes forward is the furthest a branch reaches */
+		b = hex("F0 7F");
+		b.resize(b.size() + 127, 0xEA);
+		check("branch 127 forward", flags, "\tbeq L\n" + nops(127) + "L:", b);
+
+		b = hex("D0 03 4C 85 C0");
+		b.resize(b.size() + 128, 0xEA);
+		check("branch 128 forward", flags, "\tbeq L\n" + nops(128) + "L:", b);
+
+		/* and 128 back */
+		b.assign(126, 0xEA);
+		b.push_back(0xF0);
+		b.push_back(0x80);
+		check("branch 128 back", flags, "L:\n" + nops(126) + "\tbeq L", b);
+
+		b.assign(127, 0xEA);
+		for (uint8_t x : hex("D0 03 4C 00 C0")) b.push_back(x);
+		check("branch 129 back", flags, "L:\n" + nops(127) + "\tbeq L", b);
+
+		/* the second branch growing pushes the first out of reach,
+		   which only the next pass sees */
+		b = hex("EA F0 03 4C 87 C0");
+		b.resize(b.size() + 124, 0xEA);
+		for (uint8_t x : hex("D0 03 4C 00 C0")) b.push_back(x);
+		check("branches growing in turn", flags, "top:\n\tnop\n\tbne B\n" + nops(124) + "\tbeq top\nB:", b);
+	}
+
+	/* a branch that would cross into the next page stays a jmp */
+	b.assign(252, 0xEA);
+	for (uint8_t x : hex("18 4C 01 C1 EA")) b.push_back(x);
+	check("jmp to branch, page crossed", OPT, nops(252) + "\tclc\n\tjmp L\n\tnop\nL:", b);
+
+	b.assign(250, 0xEA);
+	for (uint8_t x : hex("18 90 01 EA")) b.push_back(x);
+	check("jmp to branch, same page", OPT, nops(250) + "\tclc\n\tjmp L\n\tnop\nL:", b);
+
+	return report("optimize");
+}
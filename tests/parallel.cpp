@@ -0,0 +1,142 @@
+/*
+ * Assembles the same sources one after the other and then on several
+ * threads at once, every image, status and diagnostic has to come out
+ * the same both ways. Run from the top of the tree by make check.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "nesasm.h"
+
+#define THREADS 8
+#define ROUNDS 4
+
+static const char inc_asm[] =
+	"; included file\n"
+	"incl:\n"
+	"\tlda $00\n"
+	"\tjsr sub\n"
+	"\trts\n";
+
+static const char far_asm[] =
+	".org $C000\n"
+	".rodata\n"
+	"zp: db 0\n"
+	".text\n"
+	"_main:\n"
+	"\tldx #$00\n"
+	"\tlda zp\n"
+	"\tbne over\n"
+	"\tjsr incl\n"
+	"\tjmp near\n"
+	"near:\n"
+	"\tjmp done\n"
+	".include \"inc.asm\"\n"
+	"sub:\n"
+	"\tinx\n"
+	"\tcpx #$80\n"
+	"\tbne sub\n"
+	"\trts\n"
+	"over:\n"
+	"\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n"
+	"\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n" "\tnop\n"
+	"\tdec zp\n"
+	"\tcmp zp\n"
+	"\tbeq _main\n"
+	"done:\n"
+	"\tbrk\n";
+
+static const char err_asm[] =
+	".org $C000\n"
+	".text\n"
+	"_main:\n"
+	"\tlda #$1234\n"
+	"\tjmp nowhere\n"
+	".include \"missing.asm\"\n";
+
+struct job {
+	const char *name;
+	std::string source;
+	nesasm_options opt;
+};
+
+static bool same(const nesasm_result& a, const nesasm_result& b)
+{
+	if (a.status != b.status || a.rom != b.rom || a.diagnostics != b.diagnostics
+	 || a.symbols.size() != b.symbols.size())
+		return false;
+	for (size_t i = 0; i < a.symbols.size(); ++i)
+		if (a.symbols[i].name != b.symbols[i].name || a.symbols[i].value != b.symbols[i].value)
+			return false;
+	return true;
+}
+
+int main()
+{
+	std::ifstream f("test.asm", std::ios::binary);
+	std::stringstream test;
+	std::vector<job> jobs;
+	nesasm_resolver resolve = [](const char *path, std::string& text) {
+		if (strcmp(path, "inc.asm"))
+			return false;
+		text = inc_asm;
+		return true;
+	};
+	int differ = 0, runs = 0;
+
+	if (!f) {
+		fprintf(stderr, "parallel: no test.asm, run from the top of the tree\n");
+		return 1;
+	}
+	test << f.rdbuf();
+
+	for (int o = 0; o < 2; ++o) {
+		jobs.push_back({ "test.asm", test.str() });
+		jobs.push_back({ "far.asm", far_asm });
+		jobs.push_back({ "err.asm", err_asm });
+		for (size_t i = jobs.size() - 3; i < jobs.size(); ++i) {
+			jobs[i].opt.name = jobs[i].name;
+			jobs[i].opt.optimize = o;
+			jobs[i].opt.undocumented = o;
+		}
+	}
+
+	std::vector<nesasm_result> serial;
+	for (auto& j : jobs)
+		serial.push_back(nesasm_assemble(j.source, j.opt, resolve));
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		/* err.asm is the only one that fails */
+		if (!serial[i].status == !strcmp(jobs[i].name, "err.asm") || serial[i].rom.empty() != !!serial[i].status) {
+			fprintf(stderr, "parallel: %s assembled with status %d\n%s", jobs[i].name, serial[i].status, serial[i].diagnostics.c_str());
+			return 1;
+		}
+	}
+
+	for (int round = 0; round < ROUNDS; ++round) {
+		std::vector<nesasm_result> par(THREADS * jobs.size());
+		std::vector<std::thread> threads;
+
+		for (int n = 0; n < THREADS; ++n)
+			threads.emplace_back([&, n] {
+				for (size_t i = 0; i < jobs.size(); ++i) {
+					size_t k = (i + n) % jobs.size();
+					par[n * jobs.size() + k] = nesasm_assemble(jobs[k].source, jobs[k].opt, resolve);
+				}
+			});
+		for (auto& t : threads)
+			t.join();
+
+		for (size_t i = 0; i < par.size(); ++i, ++runs) {
+			const job& j = jobs[i % jobs.size()];
+			if (same(par[i], serial[i % jobs.size()]))
+				continue;
+			fprintf(stderr, "parallel: %s%s differs from the serial assembly\n", j.name, j.opt.optimize ? " -O" : "");
+			differ++;
+		}
+	}
+
+	printf("parallel: %d assemblies on %d threads, %d differ\n", runs, THREADS, differ);
+	return !!differ;
+}
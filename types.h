@@ -13,7 +13,10 @@
 #define INDIRECT_X  0x709
 #define INDIRECT_Y  0x70A
 #define RELATIVE    0x70B
-#define MAX_STACK 0x40
+#define ACCUMULATOR 0x70C
+#define IMPLIED     0x70D
+#define MODE_COUNT  0xE
+#define MODE(m)     ((m) - _NONE)
 
 #define TEXT_SECTION 0x0
 #define DATA_SECTION 0x1
@@ -23,9 +26,9 @@
 
 #define throwback(...)								\
 	do {											\
-		printf("%s:%d: ", curfile[sp], t->cur_line());\
-		printf(__VA_ARGS__);						\
-		putchar('\n');								\
+		fprintf(diag, "%s:%d: ", t->name(), t->cur_line());\
+		fprintf(diag, __VA_ARGS__);					\
+		fputc('\n', diag);							\
 	} while (0);
 
 enum {
@@ -39,6 +42,10 @@ enum {
 	EXTRA_OPERAND = 0x800,
 	INDIRECT_OPEN = 0x801,
 	INDIRECT_CLOSE = 0x802,
+	OPERATOR = 0x803,
+	IMMEDIATE_MARK = 0x804,
+	DIRECTIVE = 0x900,
+	DATA_LIST = 0xA00,
 };
 
 typedef unsigned char u8;